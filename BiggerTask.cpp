@@ -12,6 +12,8 @@
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QFile>
+#include <QSaveFile>
+#include <QLocale>
 #include <QWidget>
 #include <QThread>
 #include <QIcon>
@@ -35,6 +37,24 @@
 #include <thread>
 #include <chrono>
 #include <map>
+#include <bitset>
+#include <array>
+#include <unordered_map>
+#include <deque>
+#include <cerrno>
+#include <cmath>
+#include <type_traits>
+#include <memory>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
 
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
@@ -44,91 +64,422 @@
 #include <X11/extensions/Xrandr.h>
 
 // ---------- Event & Monitor models ----------
+// Packed POD; monitor indexes the owning Macro's monitor table, relx/rely are relative to it.
 struct Event {
-    enum Type { MouseMove, MouseButton, Key } type;
-    std::int64_t ms_since_start{0};
-    int x{0}, y{0};
-    int button{0};
+    enum Type : std::uint8_t { MouseMove, MouseButton, Key };
+    static constexpr std::uint8_t kNoMonitor = 0xFF;
+
+    std::int64_t us_since_start{0}; // microseconds from the start of the recording
+    std::int32_t x{0}, y{0};
+    std::int16_t relx{0}, rely{0};
+    Type type{MouseMove};
+    std::uint8_t code{0}; // button number for MouseButton, keycode for Key
     bool pressed{false};
-    unsigned int keycode{0};
-    QString monitor;
-    int relx{0}, rely{0};
+    std::uint8_t monitor{kNoMonitor};
 };
+static_assert(sizeof(Event) == 24, "Event should stay 24 bytes");
+static_assert(std::is_trivially_copyable<Event>::value, "Event must stay POD");
 
 struct MonitorInfo {
     QString name;
     int x, y, width, height;
 };
 
+// Append-only event list in fixed-size chunks, so growing it never moves existing events.
+class EventStore {
+public:
+    static constexpr size_t kChunkShift = 12; // 4096 events, 96 KiB per chunk
+    static constexpr size_t kChunkSize = size_t(1) << kChunkShift;
+    static constexpr size_t kChunkMask = kChunkSize - 1;
+
+    class const_iterator {
+    public:
+        const_iterator(const EventStore* s, size_t i) : s(s), i(i) {}
+        const Event& operator*() const { return (*s)[i]; }
+        const Event* operator->() const { return &(*s)[i]; }
+        const_iterator& operator++() { ++i; return *this; }
+        bool operator==(const const_iterator& o) const { return i == o.i; }
+        bool operator!=(const const_iterator& o) const { return i != o.i; }
+    private:
+        const EventStore* s;
+        size_t i;
+    };
+
+    EventStore() = default;
+    EventStore(EventStore&&) = default;
+    EventStore& operator=(EventStore&&) = default;
+    EventStore(const EventStore&) = delete; // macros are shared, never copied (see MacroPtr)
+    EventStore& operator=(const EventStore&) = delete;
+
+    void push_back(const Event& e) {
+        if ((count >> kChunkShift) == chunks.size()) chunks.emplace_back(new Event[kChunkSize]);
+        chunks[count >> kChunkShift][count & kChunkMask] = e;
+        ++count;
+    }
+
+    // Only sizes the chunk table; chunks themselves are allocated as they fill.
+    void reserve(size_t n) { chunks.reserve((n + kChunkMask) >> kChunkShift); }
+
+    const Event& operator[](size_t i) const { return chunks[i >> kChunkShift][i & kChunkMask]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+
+private:
+    std::vector<std::unique_ptr<Event[]>> chunks;
+    size_t count{0};
+};
+
+// A recording: the events plus the monitors they refer to (first sighting of each name).
+class MappedRecq;
+
+struct Macro {
+    EventStore events;
+    std::vector<MonitorInfo> monitors;
+    // Set for a macro played straight from a recq-v2 file; events is then left empty.
+    std::shared_ptr<const MappedRecq> mapped;
+
+    // Returns mi's table index, adding it on first use; unnamed monitors or a full table give kNoMonitor.
+    std::uint8_t internMonitor(const MonitorInfo& mi) {
+        if (mi.name.isEmpty()) return Event::kNoMonitor;
+        for (size_t i = 0; i < monitors.size(); ++i)
+            if (monitors[i].name == mi.name) return (std::uint8_t)i;
+        if (monitors.size() >= Event::kNoMonitor) return Event::kNoMonitor;
+        monitors.push_back(mi);
+        return (std::uint8_t)(monitors.size() - 1);
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t size() const;
+    // Visits every event in order, decoding a mapped file one block at a time.
+    template <typename F> void forEachEvent(F&& f) const;
+    // Visits the events recorded in [fromUs, toUs) (toUs <= 0: to the end), seeking to fromUs.
+    template <typename F> void forEachEventIn(std::int64_t fromUs, std::int64_t toUs, F&& f) const;
+};
+
+// Finished macros are immutable and shared; edits build a replacement instead.
+using MacroPtr = std::shared_ptr<const Macro>;
+
 // ---------- Helpers ----------
-static MonitorInfo findMonitorForPoint(Display* dpy, int x, int y) {
-    MonitorInfo result{"",0,0,0,0};
-    Window root = DefaultRootWindow(dpy);
-    XRRScreenResources* res = XRRGetScreenResourcesCurrent(dpy, root);
-    if (!res) return result;
-    for (int i = 0; i < res->noutput; ++i) {
-        XRROutputInfo* output = XRRGetOutputInfo(dpy, res, res->outputs[i]);
-        if (!output) continue;
-        if (output->connection == RR_Connected && output->crtc) {
-            XRRCrtcInfo* crtc = XRRGetCrtcInfo(dpy, res, output->crtc);
-            if (crtc) {
-                int w = static_cast<int>(crtc->width);
-                int h = static_cast<int>(crtc->height);
-                if (x >= crtc->x && x < crtc->x + w && y >= crtc->y && y < crtc->y + h) {
-                    result.name = output->name;
-                    result.x = crtc->x;
-                    result.y = crtc->y;
-                    result.width = w;
-                    result.height = h;
+static std::int64_t now_ms() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL;
+}
+
+static std::int64_t now_us() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000LL;
+}
+
+// Microsecond event stamps: the local clock, pulled back into the server's event millisecond.
+class CaptureClock {
+public:
+    explicit CaptureClock(std::int64_t startUs) : startUs(startUs) {}
+
+    std::int64_t stamp(Time serverTime, std::int64_t localUs) {
+        std::uint32_t t32 = (std::uint32_t)serverTime;
+        if (seenServer && t32 < lastServer && lastServer - t32 > 0x80000000u) ++serverWraps;
+        seenServer = true; lastServer = t32;
+        std::int64_t serverUs = (((std::int64_t)serverWraps << 32) + t32) * 1000LL;
+        // smallest observed delay is our best estimate of the server->local clock offset
+        offset = std::min(offset, localUs - serverUs);
+        std::int64_t lo = serverUs + offset;
+        return local(std::clamp(localUs, lo, lo + 999));
+    }
+
+    // For events with no server time (synthesized at stop): local clock, kept monotonic.
+    std::int64_t local(std::int64_t localUs) {
+        last = std::max(last, localUs - startUs);
+        return last;
+    }
+
+private:
+    std::int64_t startUs;
+    std::int64_t offset{LLONG_MAX};
+    std::int64_t last{0};
+    std::uint32_t lastServer{0};
+    std::int64_t serverWraps{0};
+    bool seenServer{false};
+};
+
+// Blocks until X input, wakeFd or timeoutMs (-1: none); call only once XPending() returned 0.
+static void waitForXEvents(Display* dpy, int wakeFd, int timeoutMs = -1) {
+    pollfd fds[2] = {{ConnectionNumber(dpy), POLLIN, 0}, {wakeFd, POLLIN, 0}};
+    int nfds = wakeFd >= 0 ? 2 : 1;
+    int timeout = timeoutMs;
+    if (wakeFd < 0 && (timeout < 0 || timeout > 10)) timeout = 10; // no eventfd: old 10 ms stop check
+    while (poll(fds, nfds, timeout) < 0 && errno == EINTR) {}
+    if (nfds == 2 && (fds[1].revents & POLLIN)) {
+        std::uint64_t v; (void)!read(wakeFd, &v, sizeof(v));
+    }
+}
+
+// ---------- Monitor topology cache ----------
+// Snapshot of the connected outputs, rebuilt after RandR changes seen by handleEvent().
+class MonitorCache {
+public:
+    explicit MonitorCache(Display* dpy) : dpy(dpy) {
+        int errorBase;
+        if (XRRQueryExtension(dpy, &rrEventBase, &errorBase)) {
+            XRRSelectInput(dpy, DefaultRootWindow(dpy),
+                           RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask | RROutputChangeNotifyMask);
+        } else {
+            rrEventBase = -1;
+        }
+    }
+
+    // Returns true if ev was a RandR notification; the cache is then invalidated.
+    bool handleEvent(XEvent& ev) {
+        if (rrEventBase < 0) return false;
+        if (ev.type == rrEventBase + RRScreenChangeNotify) XRRUpdateConfiguration(&ev);
+        else if (ev.type != rrEventBase + RRNotify) return false;
+        stale = true;
+        return true;
+    }
+
+    MonitorInfo forPoint(int x, int y) {
+        for (const auto& m : list())
+            if (x >= m.x && x < m.x + m.width && y >= m.y && y < m.y + m.height) return m;
+        return MonitorInfo{"",0,0,0,0};
+    }
+
+    MonitorInfo byName(const QString& name) {
+        for (const auto& m : list())
+            if (m.name == name) return m;
+        return MonitorInfo{"",0,0,0,0};
+    }
+
+    // Bumped on every rebuild, so callers can tell when resolved coordinates went stale.
+    unsigned generation() { list(); return gen; }
+
+private:
+    const std::vector<MonitorInfo>& list() {
+        if (stale) refresh();
+        return monitors;
+    }
+
+    void refresh() {
+        stale = false;
+        ++gen;
+        monitors.clear();
+        XRRScreenResources* res = XRRGetScreenResourcesCurrent(dpy, DefaultRootWindow(dpy));
+        if (!res) return;
+        for (int i = 0; i < res->noutput; ++i) {
+            XRROutputInfo* output = XRRGetOutputInfo(dpy, res, res->outputs[i]);
+            if (!output) continue;
+            if (output->connection == RR_Connected && output->crtc) {
+                if (XRRCrtcInfo* crtc = XRRGetCrtcInfo(dpy, res, output->crtc)) {
+                    monitors.push_back(MonitorInfo{output->name, crtc->x, crtc->y,
+                                                   static_cast<int>(crtc->width), static_cast<int>(crtc->height)});
                     XRRFreeCrtcInfo(crtc);
-                    XRRFreeOutputInfo(output);
-                    break;
                 }
-                XRRFreeCrtcInfo(crtc);
             }
+            XRRFreeOutputInfo(output);
         }
-        XRRFreeOutputInfo(output);
+        XRRFreeScreenResources(res);
     }
-    XRRFreeScreenResources(res);
-    return result;
-}
 
-static MonitorInfo findMonitorByName(Display* dpy, const QString& name) {
-    MonitorInfo result{"",0,0,0,0};
-    Window root = DefaultRootWindow(dpy);
-    XRRScreenResources* res = XRRGetScreenResourcesCurrent(dpy, root);
-    if (!res) return result;
-    for (int i = 0; i < res->noutput; ++i) {
-        XRROutputInfo* output = XRRGetOutputInfo(dpy, res, res->outputs[i]);
-        if (!output) continue;
-        if (output->connection == RR_Connected && output->crtc) {
-            XRRCrtcInfo* crtc = XRRGetCrtcInfo(dpy, res, output->crtc);
-            if (crtc) {
-                if (name == output->name) {
-                    result.name = output->name;
-                    result.x = crtc->x;
-                    result.y = crtc->y;
-                    result.width = static_cast<int>(crtc->width);
-                    result.height = static_cast<int>(crtc->height);
-                    XRRFreeCrtcInfo(crtc);
-                    XRRFreeOutputInfo(output);
-                    break;
-                }
-                XRRFreeCrtcInfo(crtc);
+    Display* dpy;
+    int rrEventBase{-1};
+    bool stale{true};
+    unsigned gen{0};
+    std::vector<MonitorInfo> monitors;
+};
+
+// ---------- Pointer tracking ----------
+// Follows the pointer from XI2 raw motion deltas; absolute devices and drift checks still query.
+class PointerTracker {
+public:
+    static constexpr std::int64_t kResyncIntervalMs = 500;
+
+    explicit PointerTracker(Display* dpy) : dpy(dpy) {
+        loadDevices();
+        resync(now_ms());
+    }
+
+    int x() const { return (int)px; }
+    int y() const { return (int)py; }
+
+    void onRawMotion(const XIRawEvent* re) {
+        if (!isRelative(re->sourceid)) { resync(now_ms()); return; }
+        const unsigned char* mask = re->valuators.mask;
+        int maskBits = re->valuators.mask_len * 8;
+        const double* v = re->valuators.values;
+        // values[] is packed: one entry per set mask bit, in axis order
+        if (maskBits > 0 && XIMaskIsSet(mask, 0)) px += *v++;
+        if (maskBits > 1 && XIMaskIsSet(mask, 1)) py += *v;
+        px = std::clamp(px, 0.0, (double)(DisplayWidth(dpy, DefaultScreen(dpy)) - 1));
+        py = std::clamp(py, 0.0, (double)(DisplayHeight(dpy, DefaultScreen(dpy)) - 1));
+    }
+
+    // Corrects accumulated drift (barriers, warps, grabs); only meaningful with the queue drained.
+    void resyncIfStale(std::int64_t now) {
+        if (now - lastSync >= kResyncIntervalMs) resync(now);
+    }
+
+private:
+    void resync(std::int64_t now) {
+        Window r, c; int rx, ry, wx, wy; unsigned int msk;
+        if (XQueryPointer(dpy, DefaultRootWindow(dpy), &r, &c, &rx, &ry, &wx, &wy, &msk)) { px = rx; py = ry; }
+        lastSync = now;
+    }
+
+    void loadDevices() {
+        relative.clear();
+        int n = 0;
+        XIDeviceInfo* info = XIQueryDevice(dpy, XIAllDevices, &n);
+        if (!info) return;
+        for (int i = 0; i < n; ++i) {
+            bool rel = false;
+            for (int c = 0; c < info[i].num_classes; ++c) {
+                if (info[i].classes[c]->type != XIValuatorClass) continue;
+                auto* vc = (XIValuatorClassInfo*)info[i].classes[c];
+                if (vc->number == 0) rel = (vc->mode == XIModeRelative);
             }
+            relative[info[i].deviceid] = rel;
         }
-        XRRFreeOutputInfo(output);
+        XIFreeDeviceInfo(info);
     }
-    XRRFreeScreenResources(res);
-    return result;
-}
 
-static std::int64_t now_ms() {
-    timespec ts{};
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL;
+    bool isRelative(int sourceid) {
+        auto it = relative.find(sourceid);
+        if (it == relative.end()) {
+            loadDevices(); // hot-plugged device: refresh once, unknown ids then count as absolute
+            it = relative.emplace(sourceid, false).first;
+        }
+        return it->second;
+    }
+
+    Display* dpy;
+    double px{0}, py{0};
+    std::int64_t lastSync{0};
+    std::unordered_map<int, bool> relative;
+};
+
+// ---------- Motion simplification ----------
+// Time-aware Ramer-Douglas-Peucker over runs of moves; clicks, keys and run endpoints pass through.
+class MotionSimplifier {
+public:
+    static constexpr size_t kMaxRun = 4096; // bounds buffering (and latency) when recording
+
+    MotionSimplifier(double tolerancePx, std::int64_t maxGapUs = 50000)
+        : tolerance(tolerancePx), maxGapUs(maxGapUs) {}
+
+    template <typename Sink>
+    void push(const Event& e, Sink&& sink) {
+        if (e.type != Event::MouseMove) { flush(sink); sink(e); return; }
+        run.push_back(e);
+        if (run.size() >= kMaxRun) flush(sink);
+    }
+
+    template <typename Sink>
+    void flush(Sink&& sink) {
+        if (run.empty()) return;
+        markKept();
+        for (size_t i = 0; i < run.size(); ++i)
+            if (keep[i]) sink(run[i]);
+        run.clear();
+    }
+
+private:
+    double sed(size_t i, size_t a, size_t b) const {
+        const Event &p = run[i], &pa = run[a], &pb = run[b];
+        double span = (double)(pb.us_since_start - pa.us_since_start);
+        double f = span > 0 ? (double)(p.us_since_start - pa.us_since_start) / span : 0.0;
+        return std::hypot(pa.x + f * (pb.x - pa.x) - p.x, pa.y + f * (pb.y - pa.y) - p.y);
+    }
+
+    void markKept() {
+        size_t n = run.size();
+        keep.assign(n, 0);
+        keep[0] = keep[n - 1] = 1;
+        stack.clear();
+        if (n > 2) stack.push_back({0, n - 1});
+        while (!stack.empty()) {
+            auto [a, b] = stack.back(); stack.pop_back();
+            double worst = -1; size_t at = a;
+            for (size_t i = a + 1; i < b; ++i) {
+                double d = sed(i, a, b);
+                if (d > worst) { worst = d; at = i; }
+            }
+            if (worst > tolerance) {
+                keep[at] = 1;
+                if (at - a > 1) stack.push_back({a, at});
+                if (b - at > 1) stack.push_back({at, b});
+            }
+        }
+        size_t last = 0;
+        for (size_t i = 1; i + 1 < n; ++i) {
+            if (!keep[i] && run[i + 1].us_since_start - run[last].us_since_start > maxGapUs) keep[i] = 1;
+            if (keep[i]) last = i;
+        }
+    }
+
+    double tolerance;
+    std::int64_t maxGapUs;
+    std::vector<Event> run;
+    std::vector<char> keep;
+    std::vector<std::pair<size_t, size_t>> stack;
+};
+
+// Offline pass over a finished macro; same rules as record-time simplification.
+static Macro simplifyMacro(const Macro& in, double tolerancePx) {
+    Macro out;
+    out.monitors = in.monitors;
+    out.events.reserve(in.size());
+    MotionSimplifier simplifier(tolerancePx);
+    auto sink = [&](const Event& e) { out.events.push_back(e); };
+    in.forEachEvent([&](const Event& e) { simplifier.push(e, sink); });
+    simplifier.flush(sink);
+    return out;
 }
 
+// ---------- Lock-free SPSC ring ----------
+// Bounded SPSC queue; push() never blocks, dropping (and counting) when full.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : cells(capacity), mask(capacity - 1) {
+        Q_ASSERT(capacity && (capacity & (capacity - 1)) == 0);
+    }
+
+    bool push(const T& v) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t depth = h - tail.load(std::memory_order_acquire);
+        if (depth == cells.size()) {
+            overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        cells[h & mask] = v;
+        head.store(h + 1, std::memory_order_release);
+        if (depth + 1 > highWater.load(std::memory_order_relaxed)) highWater.store(depth + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool pop(T& out) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        out = cells[t & mask];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t overflowCount() const { return overflows.load(std::memory_order_relaxed); }
+    size_t highWaterMark() const { return highWater.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<T> cells;
+    const size_t mask;
+    alignas(64) std::atomic<size_t> head{0}; // written by the producer only
+    alignas(64) std::atomic<size_t> tail{0}; // written by the consumer only
+    std::atomic<size_t> overflows{0};
+    std::atomic<size_t> highWater{0};
+};
+
 // ---------- Config / Combos ----------
 struct HotkeyCombo {
     std::vector<unsigned int> keys; // order-preserving, duplicates allowed
@@ -141,27 +492,896 @@ struct Config {
     HotkeyCombo stopPlayback;
 };
 
+// ---------- Macro files (.recq) ----------
+static QJsonObject recqEventToJson(const Event& e) {
+    QJsonObject o; o["t"] = e.us_since_start / 1000.0; // recq-v1 keeps milliseconds
+    if (e.type == Event::MouseMove) { o["type"]="mm"; o["x"]=e.x; o["y"]=e.y; }
+    else if (e.type == Event::MouseButton) { o["type"]="mb"; o["x"]=e.x; o["y"]=e.y; o["btn"]=(int)e.code; o["down"]=e.pressed; }
+    else { o["type"]="key"; o["code"]=(int)e.code; o["down"]=e.pressed; }
+    return o;
+}
+
+static Event recqEventFromJson(const QJsonObject& o) {
+    Event e{}; e.us_since_start = std::llround(o.value("t").toDouble() * 1000.0); auto type = o.value("type").toString();
+    if (type=="mm") { e.type=Event::MouseMove; e.x=o.value("x").toInt(); e.y=o.value("y").toInt(); }
+    else if (type=="mb") { e.type=Event::MouseButton; e.x=o.value("x").toInt(); e.y=o.value("y").toInt(); e.code=(std::uint8_t)o.value("btn").toInt(); e.pressed=o.value("down").toBool(); }
+    else if (type=="key") { e.type=Event::Key; e.code=(std::uint8_t)o.value("code").toInt(); e.pressed=o.value("down").toBool(); }
+    return e;
+}
+
+// recq-stream-v1: a header line, then one JSON object per line; loads up to the last full line.
+static const char kRecqStreamHeader[] = "{\"format\":\"recq-stream-v1\"}\n";
+
+class RecqStreamWriter {
+public:
+    static constexpr int kChunkEvents = 1024;
+    static constexpr std::int64_t kChunkIntervalUs = 1000000;
+
+    bool open(const QString& path) {
+        file.setFileName(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+        pending = kRecqStreamHeader;
+        return flush();
+    }
+
+    void addMonitor(int index, const MonitorInfo& mi) {
+        QJsonObject o; o["mon"]=index; o["name"]=mi.name; o["x"]=mi.x; o["y"]=mi.y; o["w"]=mi.width; o["h"]=mi.height;
+        appendLine(o);
+    }
+
+    void append(const Event& e) {
+        QJsonObject o = recqEventToJson(e);
+        if (e.monitor != Event::kNoMonitor && e.type != Event::Key) { o["m"]=(int)e.monitor; o["rx"]=e.relx; o["ry"]=e.rely; }
+        appendLine(o);
+        ++written;
+        if (++pendingEvents >= kChunkEvents) flush();
+    }
+
+    bool hasPending() const { return pendingEvents > 0; }
+    void flushIfDue(std::int64_t nowUs) { if (hasPending() && nowUs - lastFlushUs >= kChunkIntervalUs) flush(); }
+
+    bool flush() {
+        bool ok = file.write(pending) == pending.size() && file.flush();
+        pending.clear(); pendingEvents = 0; lastFlushUs = now_us();
+        failed = failed || !ok;
+        return ok;
+    }
+
+    // Everything is already on disk except the last chunk, so finishing is one write.
+    bool close() { flush(); file.close(); return !failed; }
+
+    bool ok() const { return !failed; }
+    size_t count() const { return written; }
+
+private:
+    void appendLine(const QJsonObject& o) {
+        pending.append(QJsonDocument(o).toJson(QJsonDocument::Compact));
+        pending.append('\n');
+    }
+
+    QFile file;
+    QByteArray pending;
+    int pendingEvents{0};
+    std::int64_t lastFlushUs{0};
+    size_t written{0};
+    bool failed{false};
+};
+
+static Macro loadRecqStream(const QByteArray& data) {
+    Macro out;
+    int pos = (int)sizeof(kRecqStreamHeader) - 1;
+    for (int nl = data.indexOf('\n', pos); nl >= 0; pos = nl + 1, nl = data.indexOf('\n', pos)) {
+        auto doc = QJsonDocument::fromJson(data.mid(pos, nl - pos));
+        if (!doc.isObject()) break;
+        auto o = doc.object();
+        if (o.contains("mon")) {
+            int idx = o.value("mon").toInt();
+            if (idx < 0 || idx >= Event::kNoMonitor) continue;
+            if ((int)out.monitors.size() <= idx) out.monitors.resize(idx + 1, MonitorInfo{"",0,0,0,0});
+            out.monitors[idx] = MonitorInfo{o.value("name").toString(), o.value("x").toInt(), o.value("y").toInt(),
+                                            o.value("w").toInt(), o.value("h").toInt()};
+            continue;
+        }
+        Event e = recqEventFromJson(o);
+        if (o.contains("m")) {
+            e.monitor = (std::uint8_t)o.value("m").toInt(Event::kNoMonitor);
+            e.relx = (std::int16_t)o.value("rx").toInt(); e.rely = (std::int16_t)o.value("ry").toInt();
+        }
+        out.events.push_back(e);
+    }
+    return out;
+}
+
+// Streaming recq-v1 reader: {"events":[...], "monitors":[...]} or a bare [...] event array.
+class RecqV1Reader {
+public:
+    explicit RecqV1Reader(QIODevice& in) : in(in), buf(kChunk, '\0') {}
+
+    // Calls sink(e) per event and fills monitors; false if the document is malformed or cut short.
+    template <typename Sink>
+    bool read(Sink&& sink, std::vector<MonitorInfo>& monitors) {
+        int c = skipWs();
+        if (c == '[') return events(sink);
+        if (!take('{')) return false;
+        if (skipWs() == '}') { ++pos; return true; }
+        for (;;) {
+            if (!string(&key) || !take(':')) return false;
+            if (key == "events" && skipWs() == '[') { if (!events(sink)) return false; }
+            else if (key == "monitors" && skipWs() == '[') { if (!monitorTable(monitors)) return false; }
+            else if (!skipValue(0)) return false;
+            c = skipWs(); ++pos;
+            if (c == '}') return true;
+            if (c != ',') return false;
+        }
+    }
+
+private:
+    static constexpr int kChunk = 1 << 16;
+    static constexpr int kMaxDepth = 64;
+
+    int peek() {
+        if (pos == len) {
+            len = eof ? 0 : (int)in.read(&buf[0], kChunk);
+            pos = 0;
+            if (len <= 0) { len = 0; eof = true; return -1; }
+        }
+        return (unsigned char)buf[pos];
+    }
+    int skipWs() {
+        int c;
+        while ((c = peek()) == ' ' || c == '\n' || c == '\r' || c == '\t') ++pos;
+        return c;
+    }
+    bool take(char ch) {
+        if (skipWs() != ch) return false;
+        ++pos; return true;
+    }
+
+    template <typename Sink>
+    bool events(Sink& sink) {
+        ++pos; // '['
+        if (skipWs() == ']') { ++pos; return true; }
+        for (;;) {
+            if (skipWs() == '{') {
+                Event e;
+                if (!event(e)) return false;
+                sink(e);
+            } else if (!skipValue(0)) return false;
+            int c = skipWs(); ++pos;
+            if (c == ']') return true;
+            if (c != ',') return false;
+        }
+    }
+
+    // One event object; unknown keys are ignored and wrong-typed values read as 0/false.
+    bool event(Event& e) {
+        ++pos; // '{'
+        double t = 0, x = 0, y = 0, btn = 0, code = 0, m = Event::kNoMonitor, rx = 0, ry = 0;
+        bool down = false;
+        type.clear();
+        if (skipWs() == '}') { ++pos; }
+        else for (;;) {
+            if (!string(&key) || !take(':')) return false;
+            bool ok = true;
+            if (key == "t") ok = number(t);
+            else if (key == "x") ok = number(x);
+            else if (key == "y") ok = number(y);
+            else if (key == "btn") ok = number(btn);
+            else if (key == "code") ok = number(code);
+            else if (key == "m") ok = number(m);
+            else if (key == "rx") ok = number(rx);
+            else if (key == "ry") ok = number(ry);
+            else if (key == "down") { down = skipWs() == 't'; ok = skipValue(0); }
+            else if (key == "type") ok = skipWs() == '"' ? string(&type) : skipValue(0);
+            else ok = skipValue(0);
+            if (!ok) return false;
+            int c = skipWs(); ++pos;
+            if (c == '}') break;
+            if (c != ',') return false;
+        }
+        auto toInt = [](double d) { return d == (double)(int)d ? (int)d : 0; };
+        e.us_since_start = std::llround(t * 1000.0);
+        if (type == "mm") { e.type = Event::MouseMove; e.x = toInt(x); e.y = toInt(y); }
+        else if (type == "mb") { e.type = Event::MouseButton; e.x = toInt(x); e.y = toInt(y); e.code = (std::uint8_t)toInt(btn); e.pressed = down; }
+        else if (type == "key") { e.type = Event::Key; e.code = (std::uint8_t)toInt(code); e.pressed = down; }
+        e.monitor = (std::uint8_t)toInt(m);
+        if (e.monitor != Event::kNoMonitor) { e.relx = (std::int16_t)toInt(rx); e.rely = (std::int16_t)toInt(ry); }
+        return true;
+    }
+
+    bool monitorTable(std::vector<MonitorInfo>& monitors) {
+        ++pos; // '['
+        if (skipWs() == ']') { ++pos; return true; }
+        for (;;) {
+            MonitorInfo mi{"", 0, 0, 0, 0};
+            if (skipWs() == '{') {
+                ++pos;
+                double x = 0, y = 0, w = 0, h = 0;
+                if (skipWs() == '}') { ++pos; }
+                else for (;;) {
+                    if (!string(&key) || !take(':')) return false;
+                    bool ok = true;
+                    if (key == "name" && skipWs() == '"') { ok = string(&scratch); mi.name = QString::fromUtf8(scratch.data(), (int)scratch.size()); }
+                    else if (key == "x") ok = number(x);
+                    else if (key == "y") ok = number(y);
+                    else if (key == "w") ok = number(w);
+                    else if (key == "h") ok = number(h);
+                    else ok = skipValue(0);
+                    if (!ok) return false;
+                    int c = skipWs(); ++pos;
+                    if (c == '}') break;
+                    if (c != ',') return false;
+                }
+                mi.x = (int)x; mi.y = (int)y; mi.width = (int)w; mi.height = (int)h;
+            } else if (!skipValue(0)) return false;
+            if (monitors.size() < Event::kNoMonitor) monitors.push_back(mi);
+            int c = skipWs(); ++pos;
+            if (c == ']') return true;
+            if (c != ',') return false;
+        }
+    }
+
+    // A string, unescaped into out (or just skipped when out is null).
+    bool string(std::string* out) {
+        if (!take('"')) return false;
+        if (out) out->clear();
+        for (;;) {
+            int c = peek(); ++pos;
+            if (c < 0) return false;
+            if (c == '"') return true;
+            if (c == '\\') {
+                c = peek(); ++pos;
+                switch (c) {
+                    case 'b': c = '\b'; break; case 'f': c = '\f'; break; case 'n': c = '\n'; break;
+                    case 'r': c = '\r'; break; case 't': c = '\t'; break;
+                    case 'u': {
+                        unsigned u = 0;
+                        if (!hex4(u)) return false;
+                        if (u >= 0xD800 && u < 0xDC00 && peek() == '\\') { // a surrogate pair is one code point
+                            ++pos;
+                            unsigned lo = 0;
+                            if (get() != 'u' || !hex4(lo) || lo < 0xDC00 || lo >= 0xE000) return false;
+                            u = 0x10000 + ((u - 0xD800) << 10) + (lo - 0xDC00);
+                        }
+                        if (out) appendUtf8(*out, u);
+                        continue;
+                    }
+                    case '"': case '\\': case '/': break;
+                    default: return false;
+                }
+            }
+            if (out) out->push_back(char(c));
+        }
+    }
+
+    int get() { int c = peek(); if (c >= 0) ++pos; return c; }
+    bool hex4(unsigned& u) {
+        for (int i = 0; i < 4; ++i) {
+            int h = get();
+            int v = h >= '0' && h <= '9' ? h - '0' : (h | 0x20) >= 'a' && (h | 0x20) <= 'f' ? (h | 0x20) - 'a' + 10 : -1;
+            if (v < 0) return false;
+            u = u << 4 | (unsigned)v;
+        }
+        return true;
+    }
+    static void appendUtf8(std::string& out, unsigned u) {
+        if (u < 0x80) { out.push_back(char(u)); return; }
+        if (u < 0x800) { out.push_back(char(0xC0 | u >> 6)); }
+        else {
+            if (u < 0x10000) out.push_back(char(0xE0 | u >> 12));
+            else { out.push_back(char(0xF0 | u >> 18)); out.push_back(char(0x80 | (u >> 12 & 0x3F))); }
+            out.push_back(char(0x80 | (u >> 6 & 0x3F)));
+        }
+        out.push_back(char(0x80 | (u & 0x3F)));
+    }
+
+    // A number into d; any other value is skipped and reads as 0.
+    bool number(double& d) {
+        int c = skipWs();
+        if (c != '-' && (c < '0' || c > '9')) { d = 0; return skipValue(0); }
+        std::string& text = scratch;
+        text.clear();
+        while ((c = peek()) == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9')) { text.push_back(char(c)); ++pos; }
+        // Exact fast path for plain decimals (2^53 digits, 1e22 scale), else Qt's C-locale parse.
+        std::uint64_t mant = 0;
+        int digits = 0, scale = 0;
+        size_t i = text[0] == '-' ? 1 : 0;
+        bool fast = i < text.size();
+        for (bool frac = false; fast && i < text.size(); ++i) {
+            char ch = text[i];
+            if (ch == '.' && !frac) { frac = true; continue; }
+            if (ch < '0' || ch > '9' || ++digits > 15) { fast = false; break; }
+            mant = mant * 10 + std::uint64_t(ch - '0');
+            if (frac) ++scale;
+        }
+        if (fast) {
+            static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                           1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+            d = (double)mant / pow10[scale];
+            if (text[0] == '-') d = -d;
+            return true;
+        }
+        bool ok = false;
+        d = QByteArray(text.data(), (int)text.size()).toDouble(&ok);
+        return ok;
+    }
+
+    bool skipValue(int depth) {
+        if (depth > kMaxDepth) return false;
+        int c = skipWs();
+        if (c == '"') return string(nullptr);
+        if (c == '{' || c == '[') {
+            const char close = c == '{' ? '}' : ']';
+            ++pos;
+            if (skipWs() == close) { ++pos; return true; }
+            for (;;) {
+                if (close == '}' && (!string(nullptr) || !take(':'))) return false;
+                if (!skipValue(depth + 1)) return false;
+                c = skipWs(); ++pos;
+                if (c == close) return true;
+                if (c != ',') return false;
+            }
+        }
+        // number or literal
+        bool any = false;
+        while ((c = peek()) >= 0 && c != ',' && c != '}' && c != ']' && c != ' ' && c != '\n' && c != '\r' && c != '\t') { ++pos; any = true; }
+        return any;
+    }
+
+    QIODevice& in;
+    std::string buf, key, type, scratch;
+    int pos{0}, len{0};
+    bool eof{false};
+};
+
+// Streaming recq-v1 writer, byte for byte what a compact QJsonDocument gave.
+class RecqV1Writer {
+public:
+    static constexpr int kFlushBytes = 1 << 16;
+
+    bool open(const QString& path) {
+        file.setFileName(path);
+        if (!file.open(QIODevice::WriteOnly)) return false;
+        out = "{\"events\":[";
+        return true;
+    }
+
+    void append(const Event& e) {
+        if (written++) out += ',';
+        switch (e.type) {
+            case Event::MouseMove:
+                out += '{'; relative(e); out += "\"t\":"; num(e.us_since_start / 1000.0);
+                out += ",\"type\":\"mm\",\"x\":"; num(e.x); out += ",\"y\":"; num(e.y);
+                break;
+            case Event::MouseButton:
+                out += "{\"btn\":"; num(e.code); out += ",\"down\":"; out += e.pressed ? "true," : "false,"; relative(e);
+                out += "\"t\":"; num(e.us_since_start / 1000.0); out += ",\"type\":\"mb\",\"x\":"; num(e.x); out += ",\"y\":"; num(e.y);
+                break;
+            case Event::Key:
+                out += "{\"code\":"; num(e.code); out += ",\"down\":"; out += e.pressed ? "true" : "false";
+                out += ",\"t\":"; num(e.us_since_start / 1000.0); out += ",\"type\":\"key\"";
+                break;
+        }
+        out += '}';
+        if (out.size() >= kFlushBytes) flush();
+    }
+
+    bool close(const std::vector<MonitorInfo>& monitors) {
+        out += "],\"format\":\"recq-v1\"";
+        if (!monitors.empty()) {
+            out += ",\"monitors\":[";
+            for (size_t i = 0; i < monitors.size(); ++i) {
+                const MonitorInfo& mi = monitors[i];
+                out += i ? ",{\"h\":" : "{\"h\":"; num(mi.height);
+                out += ",\"name\":"; str(mi.name);
+                out += ",\"w\":"; num(mi.width); out += ",\"x\":"; num(mi.x); out += ",\"y\":"; num(mi.y); out += '}';
+            }
+            out += ']';
+        }
+        out += '}';
+        flush();
+        if (failed) { file.cancelWriting(); file.commit(); return false; }
+        return file.commit();
+    }
+
+private:
+    // "m", "rx", "ry" and a trailing comma, for events recorded on a known monitor
+    void relative(const Event& e) {
+        if (e.monitor == Event::kNoMonitor) return;
+        out += "\"m\":"; num(e.monitor); out += ",\"rx\":"; num(e.relx); out += ",\"ry\":"; num(e.rely); out += ',';
+    }
+    void str(const QString& s) {
+        out += '"';
+        QByteArray utf8 = s.toUtf8();
+        for (int i = 0; i < utf8.size(); ++i) {
+            char c = utf8[i];
+            if (c == '"' || c == '\\') { out += '\\'; out += c; }
+            else if ((unsigned char)c < 0x20) { char esc[8]; snprintf(esc, sizeof(esc), "\\u%04x", c); out += esc; }
+            else out += c;
+        }
+        out += '"';
+    }
+    // QJsonDocument's formatting: whole numbers without a fraction, others shortest form
+    void num(double d) {
+        double a = std::abs(d);
+        out += QByteArray::number(d, a == (double)(std::uint64_t)a ? 'f' : 'g', QLocale::FloatingPointShortest);
+    }
+    void flush() {
+        failed = failed || file.write(out) != out.size();
+        out.clear();
+    }
+
+    QSaveFile file;
+    QByteArray out;
+    size_t written{0};
+    bool failed{false};
+};
+
+// recq-v2: binary, about a tenth of the size of v1 and decoded without a JSON parser.
+//   header  "RECQ", u8 major (2), u8 minor (1), u16 reserved
+//   blocks  u32 tag, u32 payload length, payload, u32 CRC-32 of tag+length+payload
+// All integers are little-endian; "varint" is LEB128 and "svarint" a zigzag-encoded varint.
+//   MONS  varint first index, varint count, then per monitor: varint name length, UTF-8 name,
+//         svarint x, y, varint width, height. Several blocks may extend the table.
+//   EVTS  varint count, svarint first timestamp (µs), then eight columns, each a varint byte
+//         length and its bytes: time deltas (varint), kinds (byte: type | pressed << 2), codes
+//         (byte, buttons and keys only), and for pointer events svarint deltas of x, y, monitor
+//         index (0xFF: none) and, with a monitor, of the monitor origin (x - relx, y - rely).
+//         Deltas restart in every block, so each block decodes on its own. A block holds
+//         at most 4096 events and closes once it spans a second.
+//   INDX  (minor 1) where the other blocks are: varint MONS count, then per MONS a varint
+//         offset delta; varint EVTS count, then per EVTS a varint offset delta, varint event
+//         count and svarint first timestamp delta. Offsets are from the start of the file,
+//         each list's deltas starting from 0.
+//   END   minor 0: varint total event count. minor 1: u64 total event count, u64 offset of
+//         INDX (0: none), so it is always the file's last 28 bytes. A file without END was
+//         cut short.
+// Unknown tags are skipped, a new major version is rejected; loading stops at a damaged block.
+static const char kRecqV2Magic[] = "RECQ";
+static constexpr std::uint8_t kRecqV2Major = 2, kRecqV2Minor = 1;
+static constexpr size_t kRecqV2HeaderSize = 8, kRecqV2TrailerSize = 28;
+static constexpr std::uint32_t recqTag(const char (&t)[5]) {
+    return std::uint32_t(std::uint8_t(t[0])) | std::uint32_t(std::uint8_t(t[1])) << 8
+         | std::uint32_t(std::uint8_t(t[2])) << 16 | std::uint32_t(std::uint8_t(t[3])) << 24;
+}
+static constexpr std::uint32_t kTagMonitors = recqTag("MONS"), kTagEvents = recqTag("EVTS"), kTagEnd = recqTag("END ");
+static constexpr std::uint32_t kTagIndex = recqTag("INDX");
+
+static std::uint32_t crc32(std::uint32_t crc, const std::uint8_t* p, size_t n) {
+    static const auto table = []() {
+        std::array<std::uint32_t, 256> t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    while (n--) crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putVarint(QByteArray& out, std::uint64_t v) {
+    while (v >= 0x80) { out.append(char(v | 0x80)); v >>= 7; }
+    out.append(char(v));
+}
+static void putSVarint(QByteArray& out, std::int64_t v) { putVarint(out, (std::uint64_t(v) << 1) ^ std::uint64_t(v >> 63)); }
+static void putU32(QByteArray& out, std::uint32_t v) { for (int i = 0; i < 4; ++i) out.append(char(v >> (8 * i))); }
+static void putU64(QByteArray& out, std::uint64_t v) { putU32(out, std::uint32_t(v)); putU32(out, std::uint32_t(v >> 32)); }
+
+// Bounds-checked reads over a byte range; any overrun sets ok = false and yields zeros.
+struct ByteCursor {
+    const std::uint8_t *p{nullptr}, *end{nullptr};
+    bool ok{true};
+
+    std::uint8_t byte() {
+        if (p == end) { ok = false; return 0; }
+        return *p++;
+    }
+    std::uint32_t u32() {
+        std::uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= std::uint32_t(byte()) << (8 * i);
+        return v;
+    }
+    std::uint64_t u64() { std::uint64_t lo = u32(); return lo | std::uint64_t(u32()) << 32; }
+    std::uint64_t varint() {
+        std::uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t b = byte();
+            v |= std::uint64_t(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false; return 0;
+    }
+    std::int64_t svarint() { std::uint64_t v = varint(); return std::int64_t(v >> 1) ^ -std::int64_t(v & 1); }
+    ByteCursor take(std::uint64_t n) {
+        if (n > std::uint64_t(end - p)) { ok = false; n = end - p; }
+        ByteCursor sub{p, p + n};
+        p += n;
+        return sub;
+    }
+    bool atEnd() const { return p == end; }
+};
+
+// Writes through QSaveFile, so a macro mapped from the same path stays readable while re-saved.
+class RecqV2Writer {
+public:
+    static constexpr size_t kBlockEvents = 4096;
+    static constexpr std::int64_t kBlockSpanUs = 1000000; // the index's time granularity
+
+    bool open(const QString& path) {
+        file.setFileName(path);
+        if (!file.open(QIODevice::WriteOnly)) return false;
+        QByteArray header(kRecqV2Magic, 4);
+        header.append(char(kRecqV2Major)); header.append(char(kRecqV2Minor));
+        header.append('\0'); header.append('\0'); // reserved
+        failed = file.write(header) != header.size();
+        offset = header.size();
+        return !failed;
+    }
+
+    void addMonitors(size_t first, const std::vector<MonitorInfo>& monitors) {
+        if (first >= monitors.size()) return;
+        QByteArray p;
+        putVarint(p, first); putVarint(p, monitors.size() - first);
+        for (size_t i = first; i < monitors.size(); ++i) {
+            const MonitorInfo& mi = monitors[i];
+            QByteArray name = mi.name.toUtf8();
+            putVarint(p, name.size()); p.append(name);
+            putSVarint(p, mi.x); putSVarint(p, mi.y); putVarint(p, mi.width); putVarint(p, mi.height);
+        }
+        monitorBlocks.push_back(offset);
+        writeBlock(kTagMonitors, p);
+    }
+
+    void append(const Event& e) {
+        if (!pending) firstUs = e.us_since_start;
+        else putVarint(col[Times], e.us_since_start - lastUs);
+        lastUs = e.us_since_start;
+        col[Kinds].append(char(e.type | (e.pressed ? 4 : 0)));
+        if (e.type != Event::MouseMove) col[Codes].append(char(e.code));
+        if (e.type != Event::Key) {
+            putSVarint(col[Xs], e.x - prev.x); putSVarint(col[Ys], e.y - prev.y);
+            putSVarint(col[Monitors], int(e.monitor) - int(prev.monitor));
+            prev.x = e.x; prev.y = e.y; prev.monitor = e.monitor;
+            if (e.monitor != Event::kNoMonitor) {
+                int ox = e.x - e.relx, oy = e.y - e.rely;
+                putSVarint(col[OriginXs], ox - prev.ox); putSVarint(col[OriginYs], oy - prev.oy);
+                prev.ox = ox; prev.oy = oy;
+            }
+        }
+        ++written;
+        if (++pending == kBlockEvents || e.us_since_start - firstUs >= kBlockSpanUs) flushEvents();
+    }
+
+    bool close() {
+        flushEvents();
+        std::uint64_t indexAt = offset;
+        QByteArray index;
+        putVarint(index, monitorBlocks.size());
+        std::uint64_t at = 0;
+        for (std::uint64_t m : monitorBlocks) { putVarint(index, m - at); at = m; }
+        putVarint(index, eventBlocks.size());
+        at = 0;
+        std::int64_t us = 0;
+        for (const IndexEntry& b : eventBlocks) {
+            putVarint(index, b.offset - at); putVarint(index, b.count); putSVarint(index, b.firstUs - us);
+            at = b.offset; us = b.firstUs;
+        }
+        writeBlock(kTagIndex, index);
+        QByteArray p; putU64(p, written); putU64(p, indexAt);
+        writeBlock(kTagEnd, p);
+        if (failed) { file.cancelWriting(); file.commit(); return false; }
+        return file.commit();
+    }
+
+    size_t count() const { return written; }
+
+private:
+    enum Column { Times, Kinds, Codes, Xs, Ys, Monitors, OriginXs, OriginYs, kColumns };
+
+    void flushEvents() {
+        if (!pending) return;
+        QByteArray p;
+        putVarint(p, pending); putSVarint(p, firstUs);
+        for (auto& c : col) { putVarint(p, c.size()); p.append(c); c.clear(); }
+        eventBlocks.push_back({offset, pending, firstUs});
+        writeBlock(kTagEvents, p);
+        pending = 0;
+        prev = Prev{};
+    }
+
+    void writeBlock(std::uint32_t tag, const QByteArray& payload) {
+        QByteArray frame;
+        frame.reserve(payload.size() + 12);
+        putU32(frame, tag); putU32(frame, payload.size()); frame.append(payload);
+        putU32(frame, crc32(0, (const std::uint8_t*)frame.constData(), frame.size()));
+        failed = failed || file.write(frame) != frame.size();
+        offset += frame.size();
+    }
+
+    struct Prev { int x{0}, y{0}, ox{0}, oy{0}; std::uint8_t monitor{0}; };
+    struct IndexEntry { std::uint64_t offset, count; std::int64_t firstUs; };
+    QSaveFile file;
+    QByteArray col[kColumns];
+    Prev prev;
+    size_t pending{0}, written{0};
+    std::int64_t firstUs{0}, lastUs{0};
+    std::uint64_t offset{0}; // bytes written so far, i.e. where the next block starts
+    std::vector<std::uint64_t> monitorBlocks;
+    std::vector<IndexEntry> eventBlocks;
+    bool failed{false};
+};
+
+static bool isRecqV2(const QByteArray& head) { return head.startsWith(kRecqV2Magic); }
+
+// Decodes one EVTS payload; false if it is malformed.
+template <typename Sink>
+static bool decodeRecqV2Events(ByteCursor c, Sink&& sink) {
+    std::uint64_t count = c.varint();
+    std::int64_t t = c.svarint();
+    ByteCursor times = c.take(c.varint()), kinds = c.take(c.varint()), codes = c.take(c.varint());
+    ByteCursor xs = c.take(c.varint()), ys = c.take(c.varint()), mons = c.take(c.varint());
+    ByteCursor oxs = c.take(c.varint()), oys = c.take(c.varint());
+    if (!c.ok || count != std::uint64_t(kinds.end - kinds.p)) return false;
+    int x = 0, y = 0, mon = 0, ox = 0, oy = 0;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        if (i) t += (std::int64_t)times.varint();
+        std::uint8_t k = kinds.byte();
+        Event e;
+        e.type = Event::Type(k & 3);
+        if (e.type > Event::Key) return false;
+        e.pressed = (k & 4) != 0;
+        e.us_since_start = t;
+        if (e.type != Event::MouseMove) e.code = codes.byte();
+        if (e.type != Event::Key) {
+            x += (int)xs.svarint(); y += (int)ys.svarint(); mon += (int)mons.svarint();
+            e.x = x; e.y = y; e.monitor = (std::uint8_t)mon;
+            if (e.monitor != Event::kNoMonitor) {
+                ox += (int)oxs.svarint(); oy += (int)oys.svarint();
+                e.relx = (std::int16_t)(x - ox); e.rely = (std::int16_t)(y - oy);
+            }
+        }
+        sink(e);
+    }
+    return times.ok && codes.ok && xs.ok && ys.ok && mons.ok && oxs.ok && oys.ok;
+}
+
+static bool decodeRecqV2Monitors(ByteCursor c, std::vector<MonitorInfo>& monitors) {
+    std::uint64_t first = c.varint(), count = c.varint();
+    if (!c.ok || first + count > Event::kNoMonitor) return false;
+    if (monitors.size() < first + count) monitors.resize(first + count, MonitorInfo{"", 0, 0, 0, 0});
+    for (std::uint64_t i = first; i < first + count; ++i) {
+        ByteCursor name = c.take(c.varint());
+        MonitorInfo& mi = monitors[i];
+        mi.name = QString::fromUtf8((const char*)name.p, int(name.end - name.p));
+        mi.x = (int)c.svarint(); mi.y = (int)c.svarint(); mi.width = (int)c.varint(); mi.height = (int)c.varint();
+    }
+    return c.ok;
+}
+
+// A memory-mapped recq-v2 file; event blocks are checked and decoded on demand.
+class MappedRecq {
+public:
+    // nullptr unless path is a readable recq-v2 file of a known major version.
+    static std::shared_ptr<const MappedRecq> open(const QString& path) {
+        std::shared_ptr<MappedRecq> m(new MappedRecq);
+        m->file.setFileName(path);
+        if (!m->file.open(QIODevice::ReadOnly)) return nullptr;
+        qint64 n = m->file.size();
+        if (n < (qint64)kRecqV2HeaderSize) return nullptr;
+        const uchar* base = m->file.map(0, n);
+        if (!base) { // not mappable (e.g. some network filesystems): fall back to one read
+            m->copy = m->file.readAll();
+            if (m->copy.size() != n) return nullptr;
+            base = (const uchar*)m->copy.constData();
+        }
+        m->begin = base; m->end = base + n;
+        if (base[4] != kRecqV2Major) return nullptr;
+        if (base[5] < 1 || !m->readIndex()) m->walk();
+        return m;
+    }
+
+    size_t size() const { return total; }
+    size_t blockCount() const { return blocks.size(); }
+    const std::vector<MonitorInfo>& monitors() const { return table; }
+
+    // The event block to start decoding from to reach timestamp us.
+    size_t seekBlock(std::int64_t us) const {
+        auto it = std::lower_bound(blocks.begin(), blocks.end(), us,
+                                   [](const Block& b, std::int64_t t) { return b.firstUs < t; });
+        return it == blocks.begin() ? 0 : size_t(it - blocks.begin()) - 1;
+    }
+
+    // Decodes event block i into out (replacing its contents); false if the block is damaged.
+    bool decodeBlock(size_t i, std::vector<Event>& out) const {
+        out.clear();
+        const Block& b = blocks[i];
+        ByteCursor c{b.frame, end};
+        Frame f = frame(c);
+        if (!c.ok || f.tag != kTagEvents || !f.intact()) return false;
+        return decodeRecqV2Events(f.payload, [&](const Event& e) { out.push_back(e); }) && out.size() == b.count;
+    }
+
+private:
+    struct Block {
+        const std::uint8_t* frame; // tag, length, payload, CRC
+        std::uint64_t count;
+        std::int64_t firstUs;
+    };
+    struct Frame {
+        const std::uint8_t* at;
+        std::uint32_t tag;
+        ByteCursor payload;
+        std::uint32_t crc;
+        bool intact() const { return crc == crc32(0, at, payload.end - at); }
+    };
+
+    MappedRecq() = default;
+
+    static Frame frame(ByteCursor& c) {
+        Frame f;
+        f.at = c.p;
+        f.tag = c.u32();
+        f.payload = c.take(c.u32());
+        f.crc = c.u32();
+        return f;
+    }
+
+    // Minor 1: reads END, INDX and the MONS blocks it lists; false if any is missing or damaged.
+    bool readIndex() {
+        if (end - begin < std::ptrdiff_t(kRecqV2HeaderSize + kRecqV2TrailerSize)) return false;
+        ByteCursor c{end - kRecqV2TrailerSize, end};
+        Frame last = frame(c);
+        std::uint64_t count = last.payload.u64(), indexAt = last.payload.u64();
+        const std::uint64_t limit = std::uint64_t(last.at - begin);
+        if (!c.ok || last.tag != kTagEnd || !last.payload.ok || !last.intact()
+            || indexAt < kRecqV2HeaderSize || indexAt >= limit)
+            return false;
+        ByteCursor ic{begin + indexAt, last.at};
+        Frame index = frame(ic);
+        if (!ic.ok || index.tag != kTagIndex || !index.intact()) return false;
+
+        ByteCursor p = index.payload;
+        std::vector<MonitorInfo> mons;
+        std::uint64_t at = 0;
+        for (std::uint64_t i = 0, n = p.varint(); p.ok && i < n; ++i) {
+            at += p.varint();
+            if (at < kRecqV2HeaderSize || at >= indexAt) return false;
+            ByteCursor mc{begin + at, begin + indexAt};
+            Frame m = frame(mc);
+            if (!mc.ok || m.tag != kTagMonitors || !m.intact() || !decodeRecqV2Monitors(m.payload, mons)) return false;
+        }
+        std::vector<Block> evts;
+        std::uint64_t sum = 0;
+        std::int64_t us = 0;
+        at = 0;
+        for (std::uint64_t i = 0, n = p.varint(); p.ok && i < n; ++i) {
+            at += p.varint();
+            std::uint64_t blockCount = p.varint();
+            us += p.svarint();
+            if (at < kRecqV2HeaderSize || at >= indexAt) return false;
+            evts.push_back({begin + at, blockCount, us});
+            sum += blockCount;
+        }
+        if (!p.ok || sum != count) return false;
+        table = std::move(mons); blocks = std::move(evts); total = sum;
+        return true;
+    }
+
+    void walk() {
+        ByteCursor c{begin + kRecqV2HeaderSize, end};
+        while (c.ok && !c.atEnd()) {
+            Frame f = frame(c);
+            if (!c.ok || f.tag == kTagEnd) break; // cut short, or done
+            if (f.tag == kTagMonitors) {
+                if (!f.intact() || !decodeRecqV2Monitors(f.payload, table)) break;
+            } else if (f.tag == kTagEvents) {
+                ByteCursor head = f.payload;
+                std::uint64_t count = head.varint();
+                std::int64_t firstUs = head.svarint();
+                if (!head.ok) break;
+                blocks.push_back({f.at, count, firstUs});
+                total += count;
+            }
+        }
+    }
+
+    QFile file; // keeps the mapping alive; unmapped when closed
+    QByteArray copy;
+    const std::uint8_t *begin{nullptr}, *end{nullptr};
+    std::vector<MonitorInfo> table;
+    std::vector<Block> blocks;
+    size_t total{0};
+};
+
+inline size_t Macro::size() const { return mapped ? mapped->size() : events.size(); }
+
+template <typename F>
+void Macro::forEachEvent(F&& f) const {
+    if (!mapped) {
+        for (const Event& e : events) f(e);
+        return;
+    }
+    std::vector<Event> block;
+    for (size_t b = 0; b < mapped->blockCount() && mapped->decodeBlock(b, block); ++b)
+        for (const Event& e : block) f(e);
+}
+
+template <typename F>
+void Macro::forEachEventIn(std::int64_t fromUs, std::int64_t toUs, F&& f) const {
+    auto before = [&](const Event& e) { return toUs <= 0 || e.us_since_start < toUs; };
+    if (!mapped) {
+        size_t lo = 0, hi = events.size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (events[mid].us_since_start < fromUs) lo = mid + 1; else hi = mid;
+        }
+        for (size_t i = lo; i < events.size() && before(events[i]); ++i) f(events[i]);
+        return;
+    }
+    std::vector<Event> block;
+    for (size_t b = mapped->seekBlock(fromUs); b < mapped->blockCount() && mapped->decodeBlock(b, block); ++b)
+        for (const Event& e : block) {
+            if (e.us_since_start < fromUs) continue;
+            if (!before(e)) return;
+            f(e);
+        }
+}
+
 // ---------- Recorder ----------
+// One captured input as handed from the X-draining stage to the processing stage.
+struct RawInput {
+    enum Kind : std::uint8_t { Motion, ButtonDown, ButtonUp, KeyDown, KeyUp };
+    std::int64_t us{0};
+    std::int32_t x{0}, y{0};
+    Kind kind{Motion};
+    std::uint8_t detail{0};
+};
+
+// Producer thread drains X into the ring; run() is the consumer that resolves and stores.
 class RecorderThread : public QThread {
     Q_OBJECT
 public:
-    explicit RecorderThread(QObject *parent = nullptr) : QThread(parent) {}
-    std::vector<Event> events;
-    void stop() { running = false; }
+    static constexpr size_t kRingCapacity = 1 << 16;
+    static constexpr int kNotifyEvery = 64; // producer wakes the consumer at least this often
+
+    explicit RecorderThread(QObject *parent = nullptr) : QThread(parent), ring(kRingCapacity) {
+        wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        readyFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+    ~RecorderThread() override {
+        if (wakeFd >= 0) close(wakeFd);
+        if (readyFd >= 0) close(readyFd);
+    }
+    Macro macro; // owned by the thread until finishedRecording; then taken with takeMacro()
+    QString streamPath; // if set, events go straight to this file and macro only keeps monitors
+    size_t streamedEvents = 0; // streamPath: events written, set before finishedRecording
+    double simplifyPx = 0; // > 0: drop redundant moves while recording (see MotionSimplifier)
+    void stop() {
+        running = false;
+        notify(wakeFd);
+    }
+    MacroPtr takeMacro() { return std::make_shared<const Macro>(std::move(macro)); }
 signals:
     void status(const QString &s);
-    void finishedRecording(const QString &summary);
+    void finishedRecording(const QString &summary, bool ok); // ok: false if nothing usable was recorded
 protected:
+    // Every return emits finishedRecording, which is what resets the GUI.
     void run() override {
         running = true;
         Display *dpy = XOpenDisplay(nullptr);
-        if (!dpy) { emit status("Failed to open X display"); return; }
+        if (!dpy) { emit finishedRecording("Failed to open X display", false); return; }
         int xi_opcode, event, error;
         if (!XQueryExtension(dpy, "XInputExtension", &xi_opcode, &event, &error)) {
-            emit status("XInput2 not available"); XCloseDisplay(dpy); return;
+            XCloseDisplay(dpy); emit finishedRecording("XInput2 not available", false); return;
         }
         int major = 2, minor = 0;
-        if (XIQueryVersion(dpy, &major, &minor) != Success) { emit status("XInput2 < 2.0"); XCloseDisplay(dpy); return; }
+        if (XIQueryVersion(dpy, &major, &minor) != Success) { XCloseDisplay(dpy); emit finishedRecording("XInput2 < 2.0", false); return; }
+        // The consumer gets its own connection: Xlib displays are not shared across threads here.
+        Display *cdpy = XOpenDisplay(nullptr);
+        if (!cdpy) { XCloseDisplay(dpy); emit finishedRecording("Failed to open X display", false); return; }
 
         Window root = DefaultRootWindow(dpy);
         XIEventMask mask{};
@@ -177,73 +1397,775 @@ protected:
         XISelectEvents(dpy, root, &mask, 1);
         XFlush(dpy);
 
-        events.clear();
-        auto start = now_ms();
-        emit status("Recording...");
+        macro = Macro{};
+        RecqStreamWriter stream;
+        const bool streaming = !streamPath.isEmpty();
+        if (streaming && !stream.open(streamPath)) {
+            XCloseDisplay(cdpy); XCloseDisplay(dpy); emit finishedRecording("Cannot write " + streamPath, false); return;
+        }
+        auto intern = [&](const MonitorInfo &mi) {
+            size_t known = macro.monitors.size();
+            std::uint8_t idx = macro.internMonitor(mi);
+            if (streaming && macro.monitors.size() != known) stream.addMonitor(idx, mi);
+            return idx;
+        };
+        auto write = [&](const Event &e) {
+            if (streaming) stream.append(e); else macro.events.push_back(e);
+        };
+        MotionSimplifier simplifier(simplifyPx);
+        auto store = [&](const Event &e) {
+            if (simplifyPx > 0) simplifier.push(e, write); else write(e);
+        };
+        MonitorCache monitors(cdpy);
         int last_x = -1, last_y = -1;
         std::unordered_set<int> downButtons;
+        auto process = [&](const RawInput &in) {
+            Event e; e.us_since_start = in.us; e.x = in.x; e.y = in.y;
+            switch (in.kind) {
+                case RawInput::Motion:
+                    if (in.x == last_x && in.y == last_y) return;
+                    last_x = in.x; last_y = in.y;
+                    e.type = Event::MouseMove;
+                    break;
+                case RawInput::ButtonDown:
+                case RawInput::ButtonUp:
+                    e.type = Event::MouseButton; e.code = in.detail;
+                    e.pressed = (in.kind == RawInput::ButtonDown);
+                    if (e.pressed) downButtons.insert(in.detail); else downButtons.erase(in.detail);
+                    break;
+                case RawInput::KeyDown:
+                case RawInput::KeyUp:
+                    e.type = Event::Key; e.code = in.detail; e.x = e.y = 0;
+                    e.pressed = (in.kind == RawInput::KeyDown);
+                    store(e);
+                    return;
+            }
+            MonitorInfo mi = monitors.forPoint(in.x, in.y);
+            e.monitor = intern(mi); e.relx = (std::int16_t)(in.x - mi.x); e.rely = (std::int16_t)(in.y - mi.y);
+            store(e);
+        };
 
+        startUs = now_us();
+        captureDone = false;
+        emit status("Recording...");
+        std::thread producer([&]() { capture(dpy, xi_opcode); });
+
+        bool writeErrorShown = false;
+        for (;;) {
+            bool done = captureDone.load(std::memory_order_acquire);
+            RawInput in;
+            while (ring.pop(in)) process(in);
+            if (streaming && !stream.ok() && !writeErrorShown) {
+                emit status("Write error on " + streamPath + ", the recording will be incomplete");
+                writeErrorShown = true;
+            }
+            if (done) break; // the producer has exited and everything it pushed is drained
+            if (XPending(cdpy) > 0) {
+                XEvent ev; XNextEvent(cdpy, &ev); monitors.handleEvent(ev);
+                continue;
+            }
+            waitForXEvents(cdpy, readyFd, stream.hasPending() ? 1000 : -1);
+            if (streaming) stream.flushIfDue(now_us());
+        }
+        producer.join();
+        simplifier.flush(write);
+
+        for (int b : downButtons) {
+            Event e; e.type = Event::MouseButton; e.us_since_start = finalUs; e.x = finalX; e.y = finalY; e.code = (std::uint8_t)b;
+            MonitorInfo mi = monitors.forPoint(finalX, finalY);
+            e.monitor = intern(mi); e.relx = (std::int16_t)(finalX - mi.x); e.rely = (std::int16_t)(finalY - mi.y);
+            store(e);
+        }
+        XCloseDisplay(cdpy);
+        XCloseDisplay(dpy);
+        QString queueStats = QString(" (capture queue peak %1/%2, %3 dropped)")
+                                 .arg(ring.highWaterMark()).arg(kRingCapacity).arg(ring.overflowCount());
+        if (streaming) {
+            streamedEvents = stream.count();
+            if (!stream.close()) {
+                emit finishedRecording(QString("Write error on %1: the file is incomplete (%2 events recorded)")
+                                           .arg(streamPath).arg(stream.count()), false);
+                return;
+            }
+            emit finishedRecording(QString("Recorded %1 events to %2").arg(stream.count()).arg(streamPath) + queueStats, true);
+            return;
+        }
+        emit finishedRecording(QString("Recorded %1 events").arg(macro.size()) + queueStats, true);
+    }
+private:
+    static void notify(int fd) {
+        if (fd >= 0) { std::uint64_t one = 1; (void)!write(fd, &one, sizeof(one)); }
+    }
+
+    // Producer stage. Apart from the tracker's rare resync it never waits on the server.
+    void capture(Display *dpy, int xi_opcode) {
+        PointerTracker tracker(dpy);
+        MonitorCache screen(dpy); // never queried; only keeps the screen size current for the tracker
+        CaptureClock clock(startUs);
+        int unsignalled = 0;
         while (running) {
-            if (XPending(dpy) == 0) { std::this_thread::sleep_for(std::chrono::milliseconds(10)); continue; }
+            if (XPending(dpy) == 0) {
+                if (unsignalled) { notify(readyFd); unsignalled = 0; }
+                waitForXEvents(dpy, wakeFd);
+                continue;
+            }
             XEvent ev; XNextEvent(dpy, &ev);
+            auto dequeued = now_us();
+            if (screen.handleEvent(ev)) continue;
             if (ev.xcookie.type != GenericEvent || ev.xcookie.extension != xi_opcode) continue;
             if (!XGetEventData(dpy, &ev.xcookie)) continue;
-            auto t = now_ms() - start;
+            auto *re = (XIRawEvent*)ev.xcookie.data;
+            RawInput in;
+            bool wanted = true;
             switch (ev.xcookie.evtype) {
-                case XI_RawMotion: {
-                    Window r, c; int rx, ry, x, y; unsigned int msk;
-                    XQueryPointer(dpy, root, &r, &c, &rx, &ry, &x, &y, &msk);
-                    if (x != last_x || y != last_y) {
-                        MonitorInfo mi = findMonitorForPoint(dpy, x, y);
-                        Event e; e.type = Event::MouseMove; e.ms_since_start = t; e.x = x; e.y = y;
-                        e.monitor = mi.name; e.relx = x - mi.x; e.rely = y - mi.y;
-                        events.push_back(e);
-                        last_x = x; last_y = y;
-                    }
-                    break;
-                }
-                case XI_RawButtonPress:
-                case XI_RawButtonRelease: {
-                    auto *re = (XIRawEvent*)ev.xcookie.data;
-                    Window r, c; int rx, ry, x, y; unsigned int msk;
-                    XQueryPointer(dpy, root, &r, &c, &rx, &ry, &x, &y, &msk);
-                    bool isPress = (ev.xcookie.evtype == XI_RawButtonPress);
-                    if (isPress) downButtons.insert(re->detail); else downButtons.erase(re->detail);
-                    MonitorInfo mi = findMonitorForPoint(dpy, x, y);
-                    Event e; e.type = Event::MouseButton; e.ms_since_start = t; e.x = x; e.y = y;
-                    e.button = (int)re->detail; e.pressed = isPress; e.monitor = mi.name; e.relx = x - mi.x; e.rely = y - mi.y;
-                    events.push_back(e);
-                    break;
+                case XI_RawMotion: tracker.onRawMotion(re); in.kind = RawInput::Motion; break;
+                case XI_RawButtonPress: in.kind = RawInput::ButtonDown; break;
+                case XI_RawButtonRelease: in.kind = RawInput::ButtonUp; break;
+                case XI_RawKeyPress: in.kind = RawInput::KeyDown; break;
+                case XI_RawKeyRelease: in.kind = RawInput::KeyUp; break;
+                default: wanted = false; break;
+            }
+            if (wanted) {
+                in.us = clock.stamp(re->time, dequeued);
+                in.detail = (std::uint8_t)re->detail;
+                in.x = tracker.x(); in.y = tracker.y();
+                ring.push(in);
+                if (++unsignalled >= kNotifyEvery) { notify(readyFd); unsignalled = 0; }
+            }
+            XFreeEventData(dpy, &ev.xcookie);
+            if (XEventsQueued(dpy, QueuedAlready) == 0) tracker.resyncIfStale(now_ms());
+        }
+        finalUs = clock.local(now_us());
+        finalX = tracker.x(); finalY = tracker.y();
+        captureDone.store(true, std::memory_order_release);
+        notify(readyFd);
+    }
+
+    std::atomic<bool> running{false};
+    int wakeFd{-1};  // stop() -> producer
+    int readyFd{-1}; // producer -> consumer
+    SpscRing<RawInput> ring;
+    std::int64_t startUs{0};
+    // written by the producer before captureDone is released
+    std::atomic<bool> captureDone{false};
+    std::int64_t finalUs{0};
+    int finalX{0}, finalY{0};
+};
+
+// ---------- Playback timing ----------
+// Waits for absolute CLOCK_MONOTONIC deadlines: sleeps until spinUs before, then spins.
+class DeadlineWaiter {
+public:
+    explicit DeadlineWaiter(std::int64_t spinUs) : spinUs(std::max<std::int64_t>(0, spinUs)) {}
+
+    // Returns how late we are on return, in microseconds (>= 0).
+    std::int64_t waitUntil(std::int64_t deadlineUs) {
+        std::int64_t n = now_us();
+        if (deadlineUs - n > spinUs) {
+            std::int64_t wake = deadlineUs - spinUs;
+            timespec ts{(time_t)(wake / 1000000), (long)((wake % 1000000) * 1000)};
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+            n = now_us();
+        }
+        while (n < deadlineUs) { std::this_thread::yield(); n = now_us(); }
+        return n - deadlineUs;
+    }
+
+private:
+    std::int64_t spinUs;
+};
+
+// Scheduled vs. actual injection time per event; record() never allocates.
+class LatenessLog {
+public:
+    struct Sample { std::int64_t scheduledUs, actualUs; }; // relative to the start of the run
+    static constexpr size_t kMaxSamples = size_t(1) << 21;  // 32 MiB; later events go unsampled
+    // Upper bounds (exclusive, µs) of the histogram buckets; below 0 is "early", the last is open.
+    static constexpr std::array<std::int64_t, 11> kBucketEdges{{0, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000}};
+
+    explicit LatenessLog(size_t expected) { samples.reserve(std::min(expected, kMaxSamples)); }
+
+    void record(std::int64_t scheduledUs, std::int64_t actualUs) {
+        std::int64_t late = actualUs - scheduledUs;
+        ++count; sumUs += late;
+        minUs = std::min(minUs, late); maxUs = std::max(maxUs, late);
+        size_t b = 0;
+        while (b < kBucketEdges.size() && late >= kBucketEdges[b]) ++b;
+        ++buckets[b];
+        if (samples.size() < samples.capacity()) samples.push_back({scheduledUs, actualUs});
+    }
+
+    // Sorts the sampled lateness for percentiles; call once, after the run.
+    void finish() {
+        sorted.reserve(samples.size());
+        for (const auto& s : samples) sorted.push_back(s.actualUs - s.scheduledUs);
+        std::sort(sorted.begin(), sorted.end());
+    }
+    std::int64_t percentile(double p) const {
+        if (sorted.empty()) return 0;
+        size_t i = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[std::min(sorted.size() - 1, i ? i - 1 : 0)];
+    }
+
+    QString summary(const QString& what = "lateness") const {
+        if (!count) return QString();
+        QString s = what + QString(" min %1 / p50 %2 / p99 %3 / max %4 µs, mean %5 µs over %6 events")
+            .arg(minUs).arg(percentile(50)).arg(percentile(99)).arg(maxUs).arg(sumUs / (std::int64_t)count).arg(count);
+        if (samples.size() < count) s += QString(" (percentiles of the first %1)").arg(samples.size());
+        return s;
+    }
+
+    QJsonObject toJson() const {
+        QJsonObject root;
+        root["events"] = (double)count; root["sampled"] = (double)samples.size();
+        root["minUs"] = (double)minUs; root["maxUs"] = (double)maxUs;
+        root["meanUs"] = count ? (double)sumUs / count : 0.0;
+        QJsonObject pct;
+        for (double p : {50.0, 90.0, 99.0, 99.9}) pct[QString::number(p)] = (double)percentile(p);
+        root["percentilesUs"] = pct;
+        QJsonArray hist;
+        for (size_t b = 0; b < buckets.size(); ++b) {
+            QJsonObject h;
+            if (b > 0) h["fromUs"] = (double)kBucketEdges[b - 1];
+            if (b < kBucketEdges.size()) h["toUs"] = (double)kBucketEdges[b];
+            h["count"] = (double)buckets[b];
+            hist.append(h);
+        }
+        root["histogram"] = hist;
+        QJsonArray rows;
+        for (const auto& s : samples) rows.append(QJsonArray{(double)s.scheduledUs, (double)s.actualUs});
+        root["samples"] = rows; // [scheduledUs, actualUs]
+        return root;
+    }
+
+    QByteArray toCsv() const {
+        QByteArray out("index,scheduled_us,actual_us,lateness_us\n");
+        for (size_t i = 0; i < samples.size(); ++i) {
+            const Sample& s = samples[i];
+            out += QByteArray::number((qulonglong)i) + ',' + QByteArray::number((qlonglong)s.scheduledUs) + ','
+                 + QByteArray::number((qlonglong)s.actualUs) + ',' + QByteArray::number((qlonglong)(s.actualUs - s.scheduledUs)) + '\n';
+        }
+        return out;
+    }
+
+private:
+    std::uint64_t count{0};
+    std::int64_t sumUs{0}, minUs{LLONG_MAX}, maxUs{LLONG_MIN};
+    std::array<std::uint64_t, kBucketEdges.size() + 1> buckets{};
+    std::vector<Sample> samples;
+    std::vector<std::int64_t> sorted;
+};
+
+// ---------- Playback plan ----------
+// One resolved injection: screen coordinates and a speed-scaled deadline from loop start.
+struct PlanOp {
+    enum Kind : std::uint8_t { Motion, Button, Key };
+    std::int64_t atUs{0};
+    std::int32_t x{0}, y{0};
+    Kind kind{Motion};
+    std::uint8_t code{0};
+    bool pressed{false};
+};
+
+struct PlanOptions {
+    double speed = 1.0;
+    // true: presses and releases exactly as recorded; false: the old fixed hold and auto-release.
+    bool exactButtons = true;
+    // > 0: re-time mouse moves to this many injections per second (endpoints stay exact).
+    int resampleHz = 0;
+    bool splineResample = false; // Catmull-Rom instead of linear interpolation
+    // Play only [startUs, endUs) of the recording (endUs <= 0: to the end), starting at once.
+    std::int64_t startUs = 0, endUs = 0;
+};
+
+struct PlaybackPlan {
+    std::vector<PlanOp> ops;
+    double loopSpanUs{0}; // scaled length of one loop; loop k starts at k * loopSpanUs
+    unsigned topology{0}; // MonitorCache generation the coordinates were resolved against
+    size_t unmatchedPresses{0}; // exact mode: presses with no release, released at loop end
+};
+
+// Compiles events, fed in order, into PlanOps for one set of options and monitor layout.
+class PlanCompiler {
+public:
+    static constexpr std::int64_t kAutoReleaseUs = 30000; // legacy: press with no release right after it
+    static constexpr std::int64_t kMinHoldUs = 15000;     // legacy: press immediately followed by release
+
+    // Moves further apart than this are a pause, never interpolated across.
+    static constexpr std::int64_t kMaxInterpolateUs = 100000;
+    static constexpr size_t kMaxRun = 4096;
+
+    PlanCompiler(const Macro& macro, const PlanOptions& opts, MonitorCache& monitors)
+        : speed(opts.speed), exact(opts.exactButtons), resampleHz(opts.resampleHz), spline(opts.splineResample),
+          startUs(opts.startUs), recorded(macro.monitors) {
+        relocate(monitors);
+    }
+
+    // Resolves each recorded monitor against the current layout, for events fed from now on.
+    void relocate(MonitorCache& monitors) {
+        origins.clear();
+        for (const auto& rec : recorded) {
+            MonitorInfo mi = monitors.byName(rec.name);
+            origins.push_back({!mi.name.isEmpty(), mi.x, mi.y});
+        }
+    }
+
+    void append(const Event& e, const Event* next, std::vector<PlanOp>& out) {
+        PlanOp op;
+        op.atUs = std::max(holdUntil, (std::int64_t)std::llround((e.us_since_start - startUs) / speed));
+        op.code = e.code; op.pressed = e.pressed;
+        if (e.type != Event::MouseMove) flushMotion(out);
+        switch (e.type) {
+            case Event::MouseMove:
+                op.kind = PlanOp::Motion;
+                resolve(e, op.x, op.y);
+                if (resampleHz <= 0) { out.push_back(op); break; }
+                // a pause ends a run; a very long run goes out in pieces so the buffer stays small
+                if (!motionRun.empty() && op.atUs - motionRun.back().atUs > kMaxInterpolateUs) {
+                    flushMotion(out);
+                } else if (motionRun.size() >= kMaxRun) {
+                    PlanOp tail = motionRun.back();
+                    flushMotion(out);
+                    motionRun.push_back(tail); runHeadEmitted = true;
                 }
-                case XI_RawKeyPress:
-                case XI_RawKeyRelease: {
-                    auto *re = (XIRawEvent*)ev.xcookie.data;
-                    Event e; e.type = Event::Key; e.ms_since_start = t; e.keycode = (unsigned)re->detail;
-                    e.pressed = (ev.xcookie.evtype == XI_RawKeyPress);
-                    events.push_back(e);
-                    break;
+                motionRun.push_back(op);
+                break;
+            case Event::MouseButton: {
+                // a button only carries a position when its monitor still exists
+                if (resolve(e, op.x, op.y)) { PlanOp move = op; move.kind = PlanOp::Motion; out.push_back(move); }
+                op.kind = PlanOp::Button;
+                out.push_back(op);
+                if (exact) { buttonsDown[e.code] = e.pressed; break; }
+                if (!e.pressed) break;
+                // Legacy: a minimum hold per click, a synthetic release for a lone press.
+                bool nextIsRelease = next && next->type == Event::MouseButton && next->code == e.code && !next->pressed;
+                if (nextIsRelease) {
+                    holdUntil = op.atUs + kMinHoldUs;
+                } else {
+                    holdUntil = op.atUs + kAutoReleaseUs;
+                    PlanOp release = op; release.atUs = holdUntil; release.pressed = false;
+                    out.push_back(release);
                 }
+                break;
             }
-            XFreeEventData(dpy, &ev.xcookie);
+            case Event::Key:
+                op.kind = PlanOp::Key;
+                out.push_back(op);
+                if (exact) keysDown[e.code] = e.pressed;
+                break;
         }
+    }
+
+    // Emits the buffered run of moves, resampled. Call before reading the plan's last op.
+    void flushMotion(std::vector<PlanOp>& out) {
+        if (motionRun.empty()) return;
+        size_t segStart = 0;
+        for (size_t i = 1; i <= motionRun.size(); ++i) {
+            if (i < motionRun.size() && motionRun[i].atUs - motionRun[i - 1].atUs <= kMaxInterpolateUs) continue;
+            resampleSegment(segStart, i, segStart > 0 || !runHeadEmitted, out);
+            segStart = i;
+        }
+        motionRun.clear();
+        runHeadEmitted = false;
+    }
+
+    // Feeds the next event; ops are appended to out as they become final.
+    void feed(const Event& e, std::vector<PlanOp>& out) {
+        if (havePending) { append(pending, &e, out); noteLast(out); }
+        pending = e; havePending = true;
+    }
+
+    // After the last event: returns the loop's scaled length and appends its closing ops.
+    double end(std::vector<PlanOp>& out) {
+        double span = 0;
+        if (havePending) { append(pending, nullptr, out); span = (pending.us_since_start - startUs) / speed; havePending = false; }
+        flushMotion(out);
+        noteLast(out);
+        span = std::max(span, (double)lastOpUs);
+        unmatched = finish(std::llround(span), out);
+        return span;
+    }
 
-        if (!downButtons.empty()) {
-            Window r, c; int rx, ry, x, y; unsigned int msk;
-            XQueryPointer(dpy, root, &r, &c, &rx, &ry, &x, &y, &msk);
-            auto t = now_ms() - start;
-            MonitorInfo mi = findMonitorForPoint(dpy, x, y);
-            for (int b : downButtons) {
-                Event e; e.type = Event::MouseButton; e.ms_since_start = t; e.x = x; e.y = y; e.button = b; e.pressed = false;
-                e.monitor = mi.name; e.relx = x - mi.x; e.rely = y - mi.y;
-                events.push_back(e);
+    // Exact mode: presses with no release in the macro, released by end().
+    size_t unmatchedPresses() const { return unmatched; }
+
+private:
+    struct Origin { bool found; int x, y; };
+
+    void noteLast(const std::vector<PlanOp>& out) { if (!out.empty()) lastOpUs = std::max(lastOpUs, out.back().atUs); }
+
+    // Exact mode: releases what the loop left held at loopEndUs; returns how many.
+    size_t finish(std::int64_t loopEndUs, std::vector<PlanOp>& out) {
+        size_t unmatched = 0;
+        for (int c = 0; c < 256; ++c) {
+            for (bool key : {false, true}) {
+                if (!(key ? keysDown : buttonsDown)[c]) continue;
+                PlanOp release; release.atUs = loopEndUs; release.code = (std::uint8_t)c; release.pressed = false;
+                release.kind = key ? PlanOp::Key : PlanOp::Button;
+                out.push_back(release);
+                ++unmatched;
             }
         }
-        XCloseDisplay(dpy);
-        emit status("Stopped.");
-        emit finishedRecording(QString("Recorded %1 events").arg(events.size()));
+        buttonsDown.reset(); keysDown.reset();
+        return unmatched;
+    }
+
+    // Samples motionRun[a, b) every 1/resampleHz s, keeping its endpoints; repeated pixels are skipped.
+    void resampleSegment(size_t a, size_t b, bool emitFirst, std::vector<PlanOp>& out) {
+        const PlanOp &first = motionRun[a], &last = motionRun[b - 1];
+        if (emitFirst) out.push_back(first);
+        if (b - a < 2) return;
+        const double step = 1e6 / resampleHz;
+        size_t j = a;
+        for (double t = first.atUs + step; t < last.atUs - step / 2; t += step) {
+            while (motionRun[j + 1].atUs <= t) ++j;
+            const PlanOp &p1 = motionRun[j], &p2 = motionRun[j + 1];
+            double u = (t - p1.atUs) / (double)(p2.atUs - p1.atUs);
+            double x, y;
+            if (spline) {
+                const PlanOp &p0 = motionRun[j > a ? j - 1 : j], &p3 = motionRun[j + 2 < b ? j + 2 : j + 1];
+                x = catmullRom(p0.x, p1.x, p2.x, p3.x, u);
+                y = catmullRom(p0.y, p1.y, p2.y, p3.y, u);
+            } else {
+                x = p1.x + u * (p2.x - p1.x);
+                y = p1.y + u * (p2.y - p1.y);
+            }
+            PlanOp sample = p1;
+            sample.atUs = std::llround(t); sample.x = (std::int32_t)std::lround(x); sample.y = (std::int32_t)std::lround(y);
+            if (!out.empty() && sample.x == out.back().x && sample.y == out.back().y) continue;
+            out.push_back(sample);
+        }
+        out.push_back(last);
     }
+
+    static double catmullRom(double p0, double p1, double p2, double p3, double u) {
+        return 0.5 * (2 * p1 + (p2 - p0) * u + (2 * p0 - 5 * p1 + 4 * p2 - p3) * u * u + (3 * p1 - p0 - 3 * p2 + p3) * u * u * u);
+    }
+
+    bool resolve(const Event& e, std::int32_t& x, std::int32_t& y) const {
+        x = e.x; y = e.y;
+        if (e.monitor >= origins.size() || !origins[e.monitor].found) return false;
+        x = origins[e.monitor].x + e.relx; y = origins[e.monitor].y + e.rely;
+        return true;
+    }
+
+    double speed;
+    bool exact;
+    int resampleHz;
+    bool spline;
+    std::int64_t startUs;
+    std::vector<PlanOp> motionRun;
+    bool runHeadEmitted{false};
+    const std::vector<MonitorInfo>& recorded;
+    std::vector<Origin> origins;
+    Event pending;
+    bool havePending{false};
+    std::int64_t lastOpUs{0};
+    size_t unmatched{0};
+    std::int64_t holdUntil{0};
+    std::bitset<256> buttonsDown, keysDown;
+};
+
+static PlaybackPlan compilePlan(const Macro& macro, const PlanOptions& opts, MonitorCache& monitors) {
+    PlaybackPlan plan;
+    plan.topology = monitors.generation();
+    plan.ops.reserve(macro.size() + macro.size() / 8);
+    PlanCompiler compiler(macro, opts, monitors);
+    macro.forEachEventIn(opts.startUs, opts.endUs, [&](const Event& e) { compiler.feed(e, plan.ops); });
+    plan.loopSpanUs = compiler.end(plan.ops);
+    plan.unmatchedPresses = compiler.unmatchedPresses();
+    return plan;
+}
+
+// Hands the player a loop's ops: the whole plan in memory, one compiled block at a time when mapped.
+class PlanStream {
+public:
+    PlanStream(const Macro& macro, const PlanOptions& opts, MonitorCache& monitors)
+        : macro(macro), opts(opts), monitors(monitors) {
+        if (streamed()) plan.ops.reserve(2 * RecqV2Writer::kBlockEvents);
+        else plan = compilePlan(macro, opts, monitors);
+    }
+
+    bool streamed() const { return macro.mapped != nullptr; }
+
+    // Starts a loop, resolving coordinates against the monitor layout as it is now.
+    void rewind() {
+        if (!streamed()) {
+            if (monitors.generation() != plan.topology) plan = compilePlan(macro, opts, monitors);
+            served = false;
+            return;
+        }
+        compiler.reset(new PlanCompiler(macro, opts, monitors));
+        nextBlock = macro.mapped->seekBlock(opts.startUs);
+        pastEnd = served = false;
+    }
+
+    // Layout changed mid-loop with buffer()[i] next due: returns where to continue in buffer().
+    size_t relocate(size_t i) {
+        if (streamed()) { compiler->relocate(monitors); return i; }
+        std::int64_t dueUs = plan.ops[i].atUs;
+        plan = compilePlan(macro, opts, monitors);
+        auto it = std::lower_bound(plan.ops.begin(), plan.ops.end(), dueUs,
+                                   [](const PlanOp& op, std::int64_t t) { return op.atUs < t; });
+        return size_t(it - plan.ops.begin());
+    }
+
+    // The next ops of the current loop, or nullptr once it is over; valid until the next call.
+    const std::vector<PlanOp>* next() {
+        if (!streamed()) {
+            if (served) return nullptr;
+            served = true;
+            return &plan.ops;
+        }
+        plan.ops.clear();
+        while (plan.ops.empty() && !served) {
+            if (!pastEnd && nextBlock < macro.mapped->blockCount() && macro.mapped->decodeBlock(nextBlock++, events)) {
+                for (const Event& e : events) {
+                    if (e.us_since_start < opts.startUs) continue;
+                    if (opts.endUs > 0 && e.us_since_start >= opts.endUs) { pastEnd = true; break; }
+                    compiler->feed(e, plan.ops);
+                }
+            } else { // the end, or a damaged block: the loop ends with what was readable
+                plan.loopSpanUs = compiler->end(plan.ops);
+                plan.unmatchedPresses = compiler->unmatchedPresses();
+                served = true;
+            }
+        }
+        return plan.ops.empty() ? nullptr : &plan.ops;
+    }
+
+    // The ops buffer next() hands out.
+    const std::vector<PlanOp>& buffer() const { return plan.ops; }
+    // Scaled length of the current loop; when streamed, known once next() returned nullptr.
+    double loopSpanUs() const { return plan.loopSpanUs; }
+    // Streamed: known once the first loop is over.
+    size_t unmatchedPresses() const { return plan.unmatchedPresses; }
+
 private:
-    std::atomic<bool> running{false};
+    const Macro& macro;
+    PlanOptions opts;
+    MonitorCache& monitors;
+    PlaybackPlan plan;
+    bool served{false};
+    // streamed only
+    std::unique_ptr<PlanCompiler> compiler;
+    std::vector<Event> events;
+    size_t nextBlock{0};
+    bool pastEnd{false};
+};
+
+// ---------- Real-time playback ----------
+// Best-effort SCHED_FIFO, memory locking and CPU pinning for the calling thread.
+class RealtimeScope {
+public:
+    static constexpr int kPriority = 50;
+
+    // lockAll: try mlockall first. Not for a mapped macro, where it would pull the whole file in.
+    RealtimeScope(int cpu, const std::vector<PlanOp>& ops, bool lockAll) {
+        sched_param sp{}; sp.sched_priority = kPriority;
+        if (int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp))
+            failed << QString("SCHED_FIFO refused (%1; needs CAP_SYS_NICE or an rtprio limit)").arg(strerror(err));
+        else applied << QString("SCHED_FIFO %1").arg(kPriority);
+
+        if (cpu >= 0) {
+            cpu_set_t set; CPU_ZERO(&set); CPU_SET(cpu, &set);
+            if (int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+                failed << QString("pinning to CPU %1 refused (%2)").arg(cpu).arg(strerror(err));
+            else applied << QString("CPU %1").arg(cpu);
+        }
+
+        // mlockall is usually over RLIMIT_MEMLOCK; fall back to locking just the plan.
+        track(ops);
+        if (lockAll && mlockall(MCL_CURRENT) == 0) {
+            lockedAll = true;
+            applied << "all memory locked";
+        } else {
+            int err = lockPlan();
+            if (!err) applied << "plan memory locked";
+            else failed << QString("memory locking refused (%1; raise RLIMIT_MEMLOCK)").arg(strerror(err));
+        }
+        prefault();
+    }
+
+    ~RealtimeScope() {
+        if (lockedAll) munlockall();
+        unlockPlan();
+    }
+
+    // Call with the ops buffer about to be played; relocks only if it moved or grew.
+    void planChanged(const std::vector<PlanOp>& ops) {
+        if (ops.data() == planBuf && ops.capacity() * sizeof(PlanOp) == planBytes) return;
+        if (!lockedAll) unlockPlan();
+        track(ops);
+        if (!lockedAll) lockPlan();
+        prefault();
+    }
+
+    QString notes() const {
+        QString s = "real-time: " + (applied.isEmpty() ? QString("nothing applied") : applied.join(", "));
+        if (!failed.isEmpty()) s += "; " + failed.join(", ");
+        return s;
+    }
+
+private:
+    // The whole capacity, so a streamed slice refilling the buffer stays inside it.
+    void track(const std::vector<PlanOp>& ops) { planBuf = ops.data(); planBytes = ops.capacity() * sizeof(PlanOp); }
+    // Returns 0 or the errno of the refused mlock.
+    int lockPlan() {
+        if (!planBytes) return 0;
+        planLocked = mlock(planBuf, planBytes) == 0;
+        return planLocked ? 0 : errno;
+    }
+    void unlockPlan() {
+        if (planLocked) munlock(planBuf, planBytes);
+        planLocked = false;
+    }
+    // Touch every page so the first loop does not take page faults.
+    void prefault() const {
+        const volatile char* p = reinterpret_cast<const volatile char*>(planBuf);
+        long page = sysconf(_SC_PAGESIZE);
+        for (size_t off = 0; off < planBytes; off += (size_t)page) (void)p[off];
+    }
+
+    QStringList applied, failed;
+    bool lockedAll{false};
+    bool planLocked{false};
+    const void* planBuf{nullptr};
+    size_t planBytes{0};
+};
+
+// ---------- Injection latency probe ----------
+// Matches the XI2 raw events the server echoes from XTEST devices to what the player sent.
+class InjectionProbe {
+public:
+    static constexpr size_t kRingCapacity = 1 << 16;
+    static constexpr size_t kLookahead = 64;           // button/key sends an echo may skip as lost
+    static constexpr std::int64_t kSettleUs = 250000;  // how long finish() waits for stragglers
+
+    explicit InjectionProbe(size_t expected) : sends(kRingCapacity), log(std::make_shared<LatenessLog>(expected)) {
+        wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+    ~InjectionProbe() {
+        finish();
+        if (wakeFd >= 0) close(wakeFd);
+    }
+
+    // Returns an empty string once listening, otherwise why the probe is unavailable.
+    QString start() {
+        dpy = XOpenDisplay(nullptr);
+        if (!dpy) return "no X display";
+        int event, error, major = 2, minor = 2;
+        if (!XQueryExtension(dpy, "XInputExtension", &xiOpcode, &event, &error) || XIQueryVersion(dpy, &major, &minor) != Success
+            || major * 10 + minor < 22) {
+            XCloseDisplay(dpy); dpy = nullptr; return "needs XInput 2.2";
+        }
+        int n = 0;
+        XIDeviceInfo *info = XIQueryDevice(dpy, XIAllDevices, &n);
+        for (int i = 0; i < n; ++i)
+            if ((info[i].use == XISlavePointer || info[i].use == XISlaveKeyboard) && strstr(info[i].name, "XTEST"))
+                xtestDevices.insert(info[i].deviceid);
+        if (info) XIFreeDeviceInfo(info);
+        if (xtestDevices.empty()) { XCloseDisplay(dpy); dpy = nullptr; return "no XTEST devices"; }
+
+        XIEventMask mask{};
+        unsigned char m[XIMaskLen(XI_LASTEVENT)] = {0};
+        mask.deviceid = XIAllMasterDevices;
+        mask.mask_len = sizeof(m);
+        mask.mask = m;
+        XISetMask(m, XI_RawMotion);
+        XISetMask(m, XI_RawButtonPress);
+        XISetMask(m, XI_RawButtonRelease);
+        XISetMask(m, XI_RawKeyPress);
+        XISetMask(m, XI_RawKeyRelease);
+        XISelectEvents(dpy, DefaultRootWindow(dpy), &mask, 1);
+        XSync(dpy, False); // selected before the first injection can be echoed
+        origin = now_us();
+        listener = std::thread([this]() { listen(); });
+        return QString();
+    }
+
+    // Player thread, once per injected op; never blocks or allocates.
+    void sent(const PlanOp& op) {
+        PlanOp s = op; s.atUs = now_us();
+        sends.push(s);
+    }
+
+    // Call after the player's final XSync: waits up to kSettleUs for outstanding echoes.
+    void finish() {
+        if (!listener.joinable()) return;
+        settleBy.store(now_us() + kSettleUs, std::memory_order_release);
+        if (wakeFd >= 0) { std::uint64_t one = 1; (void)!write(wakeFd, &one, sizeof(one)); }
+        listener.join();
+        XCloseDisplay(dpy); dpy = nullptr;
+        log->finish();
+    }
+
+    // Valid after finish().
+    std::shared_ptr<const LatenessLog> results() const { return log; }
+    QString summary() const {
+        QString s = log->summary("end-to-end");
+        if (lost || unmatched || sends.overflowCount())
+            s += QString(" (%1 sends without an echo, %2 unexpected echoes)").arg(lost + sends.overflowCount()).arg(unmatched);
+        return s;
+    }
+
+private:
+    void listen() {
+        std::deque<PlanOp> motions, buttons, keys;
+        auto pull = [&]() {
+            PlanOp s;
+            while (sends.pop(s))
+                (s.kind == PlanOp::Motion ? motions : s.kind == PlanOp::Button ? buttons : keys).push_back(s);
+        };
+        auto match = [&](std::deque<PlanOp>& q, std::uint8_t code, bool pressed, bool anyCode, std::int64_t echoUs) {
+            size_t limit = std::min(q.size(), anyCode ? size_t(1) : kLookahead);
+            for (size_t i = 0; i < limit; ++i) {
+                if (!anyCode && (q[i].code != code || q[i].pressed != pressed)) continue;
+                log->record(q[i].atUs - origin, echoUs - origin);
+                lost += i;
+                q.erase(q.begin(), q.begin() + i + 1);
+                return;
+            }
+            ++unmatched;
+        };
+        for (;;) {
+            std::int64_t settle = settleBy.load(std::memory_order_acquire);
+            if (settle && XPending(dpy) == 0) {
+                pull();
+                if ((motions.empty() && buttons.empty() && keys.empty()) || now_us() >= settle) break;
+            }
+            if (XPending(dpy) == 0) { waitForXEvents(dpy, wakeFd, settle ? 10 : -1); continue; }
+            XEvent ev; XNextEvent(dpy, &ev);
+            std::int64_t echoUs = now_us();
+            if (ev.xcookie.type != GenericEvent || ev.xcookie.extension != xiOpcode) continue;
+            if (!XGetEventData(dpy, &ev.xcookie)) continue;
+            auto *re = (XIRawEvent*)ev.xcookie.data;
+            if (xtestDevices.count(re->sourceid)) {
+                pull(); // the send was pushed before its request left, so it is in the ring by now
+                std::uint8_t code = (std::uint8_t)re->detail;
+                switch (ev.xcookie.evtype) {
+                    case XI_RawMotion: match(motions, 0, false, true, echoUs); break;
+                    case XI_RawButtonPress: match(buttons, code, true, false, echoUs); break;
+                    case XI_RawButtonRelease: match(buttons, code, false, false, echoUs); break;
+                    case XI_RawKeyPress: match(keys, code, true, false, echoUs); break;
+                    case XI_RawKeyRelease: match(keys, code, false, false, echoUs); break;
+                }
+            }
+            XFreeEventData(dpy, &ev.xcookie);
+        }
+        lost += motions.size() + buttons.size() + keys.size();
+    }
+
+    Display *dpy{nullptr};
+    int xiOpcode{0};
+    int wakeFd{-1};
+    std::unordered_set<int> xtestDevices;
+    SpscRing<PlanOp> sends;
+    std::shared_ptr<LatenessLog> log; // written by the listener only
+    std::int64_t origin{0};
+    std::thread listener;
+    std::atomic<std::int64_t> settleBy{0};
+    size_t lost{0}, unmatched{0};
 };
 
 // ---------- Player ----------
@@ -251,77 +2173,154 @@ class PlayerThread : public QThread {
     Q_OBJECT
 public:
     explicit PlayerThread(QObject *parent = nullptr) : QThread(parent) {}
-    std::vector<Event> events;
+    MacroPtr macro;
     double speed = 1.0;
     int loops = 1;
+    int spinUs = 1000; // busy-wait window before each deadline, see DeadlineWaiter
+    int coalesceUs = 0; // events due within this long after a batch's deadline join that batch
+    bool exactButtons = true; // see PlanOptions
+    int resampleHz = 0;       // see PlanOptions
+    bool splineResample = false;
+    std::int64_t startUs = 0, endUs = 0; // see PlanOptions
+    bool asap = false;        // ignore the timeline and inject as fast as the server keeps up
+    int syncEvery = 64;       // asap: XSync round-trip after this many events, as back-pressure
+    bool realtime = false;    // opt-in RealtimeScope for the playback thread
+    int realtimeCpu = -1;     // realtime: CPU to pin to, -1 to leave affinity alone
+    bool measureEcho = false; // run an InjectionProbe alongside playback
+    static constexpr int kLayoutCheckEvery = 64; // events between polls for RandR changes
+    std::shared_ptr<const LatenessLog> report; // set at the end of a timed run
+    std::shared_ptr<const LatenessLog> echoReport; // set at the end of a probed run
     void stop() { running = false; }
 signals:
     void status(const QString &s);
 protected:
     void run() override {
-        if (events.empty()) { emit status("No events to play"); return; }
+        if (!macro || macro->empty()) { emit status("No events to play"); return; }
         running = true;
         Display *dpy = XOpenDisplay(nullptr);
         if (!dpy) { emit status("Failed to open X display"); return; }
-        emit status(QString("Playing (%1 loops, speed x%2)...").arg(loops).arg(speed));
+        MonitorCache monitors(dpy);
+        PlanOptions opts; opts.speed = speed; opts.exactButtons = exactButtons;
+        opts.resampleHz = resampleHz; opts.splineResample = splineResample;
+        opts.startUs = startUs; opts.endUs = endUs;
+        PlanStream stream(*macro, opts, monitors);
+        QString playing = asap ? QString("Playing (%1 loops, as fast as possible)").arg(loops)
+                               : QString("Playing (%1 loops, speed x%2)").arg(loops).arg(speed);
+        if (startUs > 0 || endUs > 0)
+            playing += QString(", from %1 s to %2").arg(startUs / 1e6)
+                           .arg(endUs > 0 ? QString("%1 s").arg(endUs / 1e6) : QString("the end"));
+        if (stream.unmatchedPresses())
+            playing += QString(", %1 press(es) without a release will be released at loop end").arg(stream.unmatchedPresses());
+        // sized before RealtimeScope so its memory locking covers the buffer too
+        auto timing = std::make_shared<LatenessLog>(asap ? 0 : macro->size() * (size_t)loops);
+        std::unique_ptr<InjectionProbe> probe;
+        if (measureEcho) {
+            probe.reset(new InjectionProbe(macro->size() * (size_t)loops));
+            QString why = probe->start();
+            if (why.isEmpty()) playing += ", measuring end-to-end latency";
+            else { playing += ", end-to-end probe unavailable: " + why; probe.reset(); }
+        }
+        std::unique_ptr<RealtimeScope> rt;
+        if (realtime) {
+            rt.reset(new RealtimeScope(realtimeCpu, stream.buffer(), !stream.streamed()));
+            playing += ", " + rt->notes();
+        }
+        emit status(playing + "...");
+
+        prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0); // 1 ns slack: our sleeps end where we ask
+        DeadlineWaiter waiter(spinUs);
 
-        auto auto_release = [&](int button) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(30));
-            XTestFakeButtonEvent(dpy, button, False, 0);
-            XFlush(dpy);
+        // Batched injection: everything due by batchEnd goes out with one flush.
+        std::uint64_t flushes = 0;
+        bool unflushed = false;
+        auto flush = [&]() {
+            if (!unflushed) return;
+            XFlush(dpy); ++flushes; unflushed = false;
         };
+        std::int64_t batchEnd = LLONG_MIN, batchAt = 0;
+        // ASAP never waits; a periodic XSync keeps us from outrunning the server.
+        std::uint64_t injected = 0;
+        int sinceSync = 0;
+        // RandR notifications only mark the cache stale; true if one arrived
+        auto layoutChanged = [&]() {
+            bool seen = false;
+            while (XEventsQueued(dpy, QueuedAfterReading) > 0) { XEvent ev; XNextEvent(dpy, &ev); seen |= monitors.handleEvent(ev); }
+            return seen;
+        };
+        std::uint64_t nextLayoutCheck = kLayoutCheckEvery;
 
+        // One timeline across all loops: loop k starts at the sum of the previous loops' lengths.
+        const std::int64_t origin = now_us();
+        double loopOffsetUs = 0;
+        std::bitset<256> keysHeld, buttonsHeld;
         for (int k = 0; k < loops && running; ++k) {
-            auto start = now_ms();
-            for (size_t i = 0; i < events.size() && running; ++i) {
-                const auto &e = events[i];
-                auto target = start + (std::int64_t)(e.ms_since_start / speed);
-                auto n = now_ms();
-                if (target > n) {
-                    auto delta = target - n;
-                    timespec ts{(time_t)(delta/1000), (long)((delta%1000)*1000000)};
-                    nanosleep(&ts, nullptr);
-                }
-                switch (e.type) {
-                    case Event::MouseMove: {
-                        int absx = e.x, absy = e.y;
-                        if (!e.monitor.isEmpty()) {
-                            MonitorInfo mi = findMonitorByName(dpy, e.monitor);
-                            if (!mi.name.isEmpty()) { absx = mi.x + e.relx; absy = mi.y + e.rely; }
+            flush(); // the last loop's final batch must not wait for a recompile
+            layoutChanged(); // rewind() recompiles if the layout is new
+            stream.rewind();
+            const std::int64_t loopStart = origin + std::llround(loopOffsetUs);
+            const std::uint64_t injectedBefore = injected;
+            while (running) {
+                // decoding and compiling the next block takes a while; what is due goes out first
+                flush();
+                const std::vector<PlanOp>* ops = stream.next();
+                if (!ops) break;
+                if (rt) rt->planChanged(*ops);
+                for (size_t i = 0; i < ops->size() && running; ++i) {
+                    if (injected >= nextLayoutCheck) {
+                        nextLayoutCheck = injected + kLayoutCheckEvery;
+                        if (layoutChanged()) {
+                            flush();
+                            i = stream.relocate(i);
+                            if (rt) rt->planChanged(*ops);
+                            if (i >= ops->size()) break;
                         }
-                        XTestFakeMotionEvent(dpy, -1, absx, absy, 0); XFlush(dpy);
-                        break;
                     }
-                    case Event::MouseButton: {
-                        int absx = e.x, absy = e.y;
-                        if (!e.monitor.isEmpty()) {
-                            MonitorInfo mi = findMonitorByName(dpy, e.monitor);
-                            if (!mi.name.isEmpty()) { absx = mi.x + e.relx; absy = mi.y + e.rely;
-                                XTestFakeMotionEvent(dpy, -1, absx, absy, 0); }
-                        }
-                        XTestFakeButtonEvent(dpy, e.button, e.pressed, 0); XFlush(dpy);
-                        if (e.pressed) {
-                            bool nextIsRelease = false;
-                            if (i + 1 < events.size()) {
-                                const auto &next = events[i+1];
-                                nextIsRelease = (next.type == Event::MouseButton && next.button == e.button && !next.pressed);
-                            }
-                            if (!nextIsRelease) auto_release(e.button);
-                            else std::this_thread::sleep_for(std::chrono::milliseconds(15));
-                        }
-                        break;
+                    const PlanOp &op = (*ops)[i];
+                    std::int64_t target = loopStart + op.atUs;
+                    if (asap) {
+                        if (++sinceSync >= syncEvery) { XSync(dpy, False); ++flushes; unflushed = false; sinceSync = 0; }
+                    } else if (target > batchEnd) {
+                        flush();
+                        batchAt = target + waiter.waitUntil(target);
+                        batchEnd = target + coalesceUs;
                     }
-                    case Event::Key:
-                        XTestFakeKeyEvent(dpy, e.keycode, e.pressed, 0);
-                        XFlush(dpy);
-                        break;
+                    if (!asap) timing->record(target - origin, batchAt - origin);
+                    if (probe) probe->sent(op);
+                    switch (op.kind) {
+                        case PlanOp::Motion: XTestFakeMotionEvent(dpy, -1, op.x, op.y, 0); break;
+                        case PlanOp::Button: XTestFakeButtonEvent(dpy, op.code, op.pressed, 0); buttonsHeld[op.code] = op.pressed; break;
+                        case PlanOp::Key: XTestFakeKeyEvent(dpy, op.code, op.pressed, 0); keysHeld[op.code] = op.pressed; break;
+                    }
+                    unflushed = true;
+                    ++injected;
                 }
             }
+            loopOffsetUs += stream.loopSpanUs();
+            if (injected == injectedBefore) break; // nothing recorded in the chosen range
+            if (k == 0 && stream.streamed() && stream.unmatchedPresses() && loops > 1 && running)
+                emit status(playing + QString(", %1 press(es) without a release are released at loop end...").arg(stream.unmatchedPresses()));
         }
-        for (int b = 1; b <= 7; ++b) XTestFakeButtonEvent(dpy, b, False, 0);
-        XFlush(dpy);
+        flush();
+        XSync(dpy, False); // count the run as finished once the server has really executed it
+        double elapsedS = (now_us() - origin) / 1e6;
+        if (probe) probe->finish(); // before the releases below, which are not part of the run
+        // Stopped part-way: release the keys and buttons playback left pressed
+        for (int c = 0; c < 256; ++c) if (keysHeld[c]) XTestFakeKeyEvent(dpy, c, False, 0);
+        for (int b = 0; b < 256; ++b) if (buttonsHeld[b]) XTestFakeButtonEvent(dpy, b, False, 0);
+        XSync(dpy, False);
         XCloseDisplay(dpy);
-        emit status("Playback finished.");
+        timing->finish();
+        // read by the GUI once it sees "finished"
+        if (!asap) report = timing;
+        if (probe) echoReport = probe->results();
+        QString summary = timing->summary();
+        if (!summary.isEmpty()) summary += ", ";
+        summary += QString("%1 flushes").arg(flushes);
+        if (stream.unmatchedPresses()) summary += QString(", %1 press(es) released at loop end").arg(stream.unmatchedPresses());
+        if (elapsedS > 0) summary += QString(", %1 events/s").arg(std::llround(injected / elapsedS));
+        if (probe) summary += ", " + probe->summary();
+        if (rt) summary += ", " + rt->notes();
+        emit status(QString("Playback finished (%1).").arg(summary));
     }
 private:
     std::atomic<bool> running{false};
@@ -533,11 +2532,39 @@ private:
     PlayerThread *activePlayer{nullptr};
     GlobalKeyWatcher *keyWatcher{nullptr};
 
-    std::vector<Event> recorded;
+    MacroPtr recorded;
+    QString unloadedRecording; // a streamed recording, read back only once something needs it
+    bool haveMacro() const { return !unloadedRecording.isEmpty() || (recorded && !recorded->empty()); }
+    const MacroPtr& currentMacro() {
+        if (!unloadedRecording.isEmpty()) {
+            recorded = std::make_shared<const Macro>(loadRecq(unloadedRecording));
+            unloadedRecording.clear();
+        }
+        return recorded;
+    }
     QLabel *status{nullptr};
     QDoubleSpinBox *spinSpeed{nullptr};
     QSpinBox *spinLoops{nullptr};
     QCheckBox *chkInfinite{nullptr};
+    QCheckBox *chkStream{nullptr};
+    QDoubleSpinBox *spinFrom{nullptr};
+    QDoubleSpinBox *spinTo{nullptr};
+    QDoubleSpinBox *spinSimplify{nullptr};
+    QPushButton *btnSimplify{nullptr};
+    QCheckBox *chkSimplifyRecording{nullptr};
+    QSpinBox *spinResample{nullptr};
+    QCheckBox *chkSpline{nullptr};
+    QPushButton *btnExportTiming{nullptr};
+    std::shared_ptr<const LatenessLog> lastTiming; // from the last timed playback
+    std::shared_ptr<const LatenessLog> lastEcho;   // from the last probed playback
+    QCheckBox *chkEcho{nullptr};
+    QSpinBox *spinSpinWindow{nullptr};
+    QSpinBox *spinCoalesce{nullptr};
+    QCheckBox *chkExactButtons{nullptr};
+    QCheckBox *chkAsap{nullptr};
+    QSpinBox *spinSyncEvery{nullptr};
+    QCheckBox *chkRealtime{nullptr};
+    QSpinBox *spinRealtimeCpu{nullptr};
     QPushButton *btnRecord{nullptr};
     QPushButton *btnPlay{nullptr};
     QPushButton *btnSave{nullptr};
@@ -607,20 +2634,81 @@ private:
         h1->addWidget(btnRecord); h1->addWidget(btnPlay); h1->addWidget(btnSave); h1->addWidget(btnLoad); h1->addWidget(btnHotkey);
 
         auto *h2 = new QHBoxLayout();
-        spinSpeed = new QDoubleSpinBox(); spinSpeed->setRange(0.1, 5.0); spinSpeed->setValue(1.0);
+        spinSpeed = new QDoubleSpinBox(); spinSpeed->setRange(0.1, 1000.0); spinSpeed->setValue(1.0);
         spinLoops = new QSpinBox(); spinLoops->setRange(1, 999); spinLoops->setValue(1);
         chkInfinite = new QCheckBox("Infinite loop");
-        h2->addWidget(new QLabel("Speed:")); h2->addWidget(spinSpeed); h2->addWidget(new QLabel("Loops:")); h2->addWidget(spinLoops); h2->addWidget(chkInfinite);
+        chkStream = new QCheckBox("Record to file");
+        chkStream->setToolTip("Write events to disk while recording instead of keeping them in memory");
+        h2->addWidget(new QLabel("Speed:")); h2->addWidget(spinSpeed); h2->addWidget(new QLabel("Loops:")); h2->addWidget(spinLoops); h2->addWidget(chkInfinite); h2->addWidget(chkStream);
+        spinFrom = new QDoubleSpinBox(); spinFrom->setRange(0.0, 1e6); spinFrom->setValue(0.0);
+        spinFrom->setSuffix(" s"); spinFrom->setSpecialValueText("Start");
+        spinFrom->setToolTip("Play from this point of the recording, e.g. to preview a segment or resume a long run");
+        spinTo = new QDoubleSpinBox(); spinTo->setRange(0.0, 1e6); spinTo->setValue(0.0);
+        spinTo->setSuffix(" s"); spinTo->setSpecialValueText("End");
+        spinTo->setToolTip("Stop at this point of the recording");
+        h2->addWidget(new QLabel("From:")); h2->addWidget(spinFrom); h2->addWidget(new QLabel("To:")); h2->addWidget(spinTo);
+
+        auto *h3 = new QHBoxLayout();
+        spinSimplify = new QDoubleSpinBox(); spinSimplify->setRange(0.0, 50.0); spinSimplify->setValue(0.0);
+        spinSimplify->setSuffix(" px"); spinSimplify->setSpecialValueText("Off");
+        spinSimplify->setToolTip("Drop mouse moves that stay within this distance of the simplified path");
+        btnSimplify = new QPushButton("Simplify");
+        btnSimplify->setToolTip("Replace the current macro with a simplified copy, kept in memory (a binary macro is no longer played from its file)");
+        chkSimplifyRecording = new QCheckBox("Simplify while recording");
+        chkSimplifyRecording->setToolTip("Also apply the tolerance to new recordings (moves dropped this way cannot be recovered)");
+        h3->addWidget(new QLabel("Simplify moves:")); h3->addWidget(spinSimplify); h3->addWidget(btnSimplify); h3->addWidget(chkSimplifyRecording);
+        spinResample = new QSpinBox(); spinResample->setRange(0, 1000); spinResample->setValue(0);
+        spinResample->setSuffix(" Hz"); spinResample->setSpecialValueText("Off");
+        spinResample->setToolTip("Replay mouse moves at this rate: interpolate extra moves (e.g. 240-1000 Hz) or thin them out (e.g. 30-60 Hz)");
+        chkSpline = new QCheckBox("Smooth curve");
+        chkSpline->setToolTip("Interpolate resampled moves along a Catmull-Rom spline instead of straight lines");
+        h3->addWidget(new QLabel("Resample:")); h3->addWidget(spinResample); h3->addWidget(chkSpline);
+
+        auto *h4 = new QHBoxLayout();
+        spinSpinWindow = new QSpinBox(); spinSpinWindow->setRange(0, 20000); spinSpinWindow->setSingleStep(250); spinSpinWindow->setValue(1000);
+        spinSpinWindow->setSuffix(" µs");
+        spinSpinWindow->setToolTip("Sleep until this long before each event, then busy-wait for precise timing (0 = sleep only)");
+        spinCoalesce = new QSpinBox(); spinCoalesce->setRange(0, 50000); spinCoalesce->setSingleStep(500); spinCoalesce->setValue(0);
+        spinCoalesce->setSuffix(" µs");
+        spinCoalesce->setToolTip("Inject events due within this window together, with a single flush (0 = only events due at the same time)");
+        h4->addWidget(new QLabel("Spin window:")); h4->addWidget(spinSpinWindow);
+        h4->addWidget(new QLabel("Batch window:")); h4->addWidget(spinCoalesce);
+        chkExactButtons = new QCheckBox("Exact click timing"); chkExactButtons->setChecked(true);
+        chkExactButtons->setToolTip("Replay presses and releases exactly as recorded. Unchecked: old behaviour with a fixed 15 ms hold and 30 ms auto-release");
+        h4->addWidget(chkExactButtons);
+        btnExportTiming = new QPushButton("Export timing");
+        btnExportTiming->setToolTip("Save the last playback's scheduled vs. actual injection times as JSON or CSV");
+        h4->addWidget(btnExportTiming);
+
+        auto *h5 = new QHBoxLayout();
+        chkAsap = new QCheckBox("As fast as possible");
+        chkAsap->setToolTip("Ignore recorded timing and inject events back to back");
+        spinSyncEvery = new QSpinBox(); spinSyncEvery->setRange(1, 100000); spinSyncEvery->setValue(64);
+        spinSyncEvery->setToolTip("Wait for the X server to catch up after this many events");
+        h5->addWidget(chkAsap); h5->addWidget(new QLabel("Sync every:")); h5->addWidget(spinSyncEvery); h5->addWidget(new QLabel("events"));
+        chkRealtime = new QCheckBox("Real-time");
+        chkRealtime->setToolTip("Run playback with SCHED_FIFO priority and locked memory when the system allows it");
+        spinRealtimeCpu = new QSpinBox(); spinRealtimeCpu->setRange(-1, 1023); spinRealtimeCpu->setValue(-1);
+        spinRealtimeCpu->setSpecialValueText("Any"); spinRealtimeCpu->setToolTip("Pin the playback thread to this CPU");
+        h5->addWidget(chkRealtime); h5->addWidget(new QLabel("CPU:")); h5->addWidget(spinRealtimeCpu);
+        chkEcho = new QCheckBox("Measure end-to-end");
+        chkEcho->setToolTip("Listen for the input events playback produces and report how long the X server took to deliver them");
+        h5->addWidget(chkEcho);
 
         status = new QLabel("Ready.");
 
         v->addLayout(h1);
         v->addLayout(h2);
+        v->addLayout(h3);
+        v->addLayout(h4);
+        v->addLayout(h5);
         v->addWidget(status);
         setCentralWidget(central);
 
         btnPlay->setEnabled(false);
         btnSave->setEnabled(false);
+        btnSimplify->setEnabled(false);
+        btnExportTiming->setEnabled(false);
 
         // Record button
         connect(btnRecord, &QPushButton::clicked, this, &MainWindow::onToggleRecord);
@@ -629,12 +2717,14 @@ private:
 
         // Save
         connect(btnSave, &QPushButton::clicked, this, [this]() {
-            if (recorded.empty()) return;
+            if (!haveMacro()) return;
             QString startDir = config.lastDir.isEmpty() ? QDir::homePath() : config.lastDir;
-            QString path = QFileDialog::getSaveFileName(this, "Save macro", startDir, "Macro (*.recq)");
+            QString legacy = "Macro, JSON recq-v1 (*.recq)", filter;
+            QString path = QFileDialog::getSaveFileName(this, "Save macro", startDir, "Macro (*.recq);;" + legacy, &filter);
             if (path.isEmpty()) return;
             if (!path.endsWith(".recq")) path += ".recq";
-            if (saveRecq(path, recorded)) { QFileInfo fi(path); config.lastDir = fi.absolutePath(); saveConfig(); }
+            const Macro& macro = *currentMacro();
+            if (filter == legacy ? saveRecq(path, macro) : saveRecqV2(path, macro)) { QFileInfo fi(path); config.lastDir = fi.absolutePath(); saveConfig(); }
             else QMessageBox::warning(this, "Save failed", "Failed to save file.");
         });
 
@@ -643,10 +2733,31 @@ private:
             QString startDir = config.lastDir.isEmpty() ? QDir::homePath() : config.lastDir;
             QString path = QFileDialog::getOpenFileName(this, "Load macro", startDir, "Macro (*.recq)");
             if (path.isEmpty()) return;
-            recorded = loadRecq(path);
-            if (!recorded.empty()) { QFileInfo fi(path); config.lastDir = fi.absolutePath(); saveConfig(); }
-            btnPlay->setEnabled(!recorded.empty()); btnSave->setEnabled(!recorded.empty());
-            status->setText(QString("Loaded %1 events").arg(recorded.size()));
+            bool damaged = false;
+            recorded = std::make_shared<const Macro>(loadRecq(path, &damaged));
+            unloadedRecording.clear();
+            if (haveMacro()) { QFileInfo fi(path); config.lastDir = fi.absolutePath(); saveConfig(); }
+            btnPlay->setEnabled(haveMacro()); btnSave->setEnabled(haveMacro()); btnSimplify->setEnabled(haveMacro());
+            if (damaged) status->setText(QString("Loaded %1 events (file damaged after event %1)").arg(recorded->size()));
+            else status->setText(QString("Loaded %1 events").arg(recorded->size()));
+        });
+
+        // Simplify: replaces the current macro with a simplified copy
+        connect(btnSimplify, &QPushButton::clicked, this, [this]() {
+            if (!haveMacro() || spinSimplify->value() <= 0) return;
+            size_t before = currentMacro()->size();
+            recorded = std::make_shared<const Macro>(simplifyMacro(*recorded, spinSimplify->value()));
+            status->setText(QString("Simplified %1 -> %2 events").arg(before).arg(recorded->size()));
+        });
+
+        // Export the last playback's timing log
+        connect(btnExportTiming, &QPushButton::clicked, this, [this]() {
+            if (!lastTiming && !lastEcho) return;
+            QString startDir = config.lastDir.isEmpty() ? QDir::homePath() : config.lastDir;
+            QString path = QFileDialog::getSaveFileName(this, "Export timing", startDir, "Timing JSON (*.json);;Timing CSV (*.csv)");
+            if (path.isEmpty()) return;
+            if (!exportTiming(path, lastTiming.get(), lastEcho.get()))
+                QMessageBox::warning(this, "Export failed", "Failed to write file.");
         });
 
         // Hotkeys menu (capture or clear)
@@ -672,14 +2783,32 @@ private:
 
     Q_SLOT void onToggleRecord() {
         if (!activeRecorder) {
+            QString streamPath;
+            if (chkStream->isChecked()) {
+                QString startDir = config.lastDir.isEmpty() ? QDir::homePath() : config.lastDir;
+                streamPath = QFileDialog::getSaveFileName(this, "Record to file", startDir, "Macro (*.recq)");
+                if (streamPath.isEmpty()) return;
+                if (!streamPath.endsWith(".recq")) streamPath += ".recq";
+            }
             activeRecorder = new RecorderThread(this);
+            activeRecorder->streamPath = streamPath;
+            activeRecorder->simplifyPx = chkSimplifyRecording->isChecked() ? spinSimplify->value() : 0.0;
             connect(activeRecorder, &RecorderThread::status, this, [this](const QString &s){ status->setText(s); });
-            connect(activeRecorder, &RecorderThread::finishedRecording, this, [this](const QString &s){
+            connect(activeRecorder, &RecorderThread::finishedRecording, this, [this](const QString &s, bool ok){
                 status->setText(s);
-                recorded = activeRecorder->events;
+                if (ok && activeRecorder->streamPath.isEmpty()) {
+                    recorded = activeRecorder->takeMacro();
+                    unloadedRecording.clear();
+                } else if (ok) {
+                    // a long session's file is only parsed when played, saved or simplified
+                    recorded.reset();
+                    unloadedRecording = activeRecorder->streamedEvents ? activeRecorder->streamPath : QString();
+                }
                 btnRecord->setText("Record");
                 btnPlay->setEnabled(true);
-                btnSave->setEnabled(!recorded.empty());
+                btnSave->setEnabled(haveMacro());
+                btnSimplify->setEnabled(haveMacro());
+                activeRecorder->wait(); // emitted on the way out of run()
                 activeRecorder->deleteLater();
                 activeRecorder = nullptr;
             });
@@ -687,6 +2816,7 @@ private:
             btnRecord->setText("Stop");
             btnPlay->setEnabled(false);
             btnSave->setEnabled(false);
+            btnSimplify->setEnabled(false);
         } else {
             activeRecorder->stop();
             btnRecord->setText("Record");
@@ -699,17 +2829,39 @@ private:
         return;
     }
 
-    if (!recorded.empty()) {
+    if (haveMacro() && currentMacro()->empty()) { // a streamed recording's file may be gone by now
+        status->setText("No events to play");
+        btnPlay->setEnabled(false); btnSave->setEnabled(false); btnSimplify->setEnabled(false);
+        return;
+    }
+
+    if (haveMacro()) {
         activePlayer = new PlayerThread(this);
-        activePlayer->events = recorded;
+        activePlayer->macro = currentMacro();
         activePlayer->speed = spinSpeed->value();
         activePlayer->loops = chkInfinite->isChecked() ? INT_MAX : spinLoops->value();
+        activePlayer->spinUs = spinSpinWindow->value();
+        activePlayer->coalesceUs = spinCoalesce->value();
+        activePlayer->exactButtons = chkExactButtons->isChecked();
+        activePlayer->resampleHz = spinResample->value();
+        activePlayer->splineResample = chkSpline->isChecked();
+        activePlayer->startUs = std::llround(spinFrom->value() * 1e6);
+        activePlayer->endUs = std::llround(spinTo->value() * 1e6);
+        activePlayer->asap = chkAsap->isChecked();
+        activePlayer->syncEvery = spinSyncEvery->value();
+        activePlayer->realtime = chkRealtime->isChecked();
+        activePlayer->realtimeCpu = spinRealtimeCpu->value();
+        activePlayer->measureEcho = chkEcho->isChecked();
 
         connect(activePlayer, &PlayerThread::status, this, [this](const QString &s){
             status->setText(s);
             if (s.contains("finished", Qt::CaseInsensitive) || s.contains("Stopped", Qt::CaseInsensitive)) {
                 btnPlay->setText("Play");
                 btnRecord->setEnabled(true);
+                if (activePlayer) {
+                    lastTiming = activePlayer->report; lastEcho = activePlayer->echoReport;
+                    btnExportTiming->setEnabled(lastTiming || lastEcho);
+                }
                 if (activePlayer) { activePlayer->deleteLater(); activePlayer = nullptr; }
             }
         });
@@ -822,42 +2974,53 @@ if (seq.size() >= 3) {
     delete workerThread;
 }
 
+public:
+    // Save as recq-v1 or recq-v2, load any of them (v2 mapped in place); public for the headless benchmark
+    static bool saveRecq(const QString &path, const Macro &macro) {
+        RecqV1Writer w; if (!w.open(path)) return false;
+        macro.forEachEvent([&](const Event &e) { w.append(e); });
+        return w.close(macro.monitors);
+    }
 
-    // Save/load .recq (unchanged)
-    static bool saveRecq(const QString &path, const std::vector<Event> &evs) {
-        QJsonArray arr;
-        for (const auto &e : evs) {
-            QJsonObject o; o["t"] = (double)e.ms_since_start;
-            if (e.type == Event::MouseMove) { o["type"]="mm"; o["x"]=e.x; o["y"]=e.y; }
-            else if (e.type == Event::MouseButton) { o["type"]="mb"; o["x"]=e.x; o["y"]=e.y; o["btn"]=e.button; o["down"]=e.pressed; }
-            else { o["type"]="key"; o["code"]=(int)e.keycode; o["down"]=e.pressed; }
-            arr.append(o);
-        }
-        QJsonObject root; root["format"]="recq-v1"; root["events"]=arr;
-        QJsonDocument doc(root); QFile f(path); if (!f.open(QIODevice::WriteOnly)) return false; f.write(doc.toJson(QJsonDocument::Compact)); f.close(); return true;
-    }
-
-    static std::vector<Event> loadRecq(const QString &path) {
-        std::vector<Event> out; QFile f(path); if (!f.open(QIODevice::ReadOnly)) return out; auto data = f.readAll(); f.close();
-        auto doc = QJsonDocument::fromJson(data);
-        if (doc.isObject()) {
-            auto root = doc.object(); auto arr = root.value("events").toArray();
-            for (auto v : arr) {
-                auto o = v.toObject(); Event e{}; e.ms_since_start = (std::int64_t)o.value("t").toDouble(); auto type = o.value("type").toString();
-                if (type=="mm") { e.type=Event::MouseMove; e.x=o.value("x").toInt(); e.y=o.value("y").toInt(); }
-                else if (type=="mb") { e.type=Event::MouseButton; e.x=o.value("x").toInt(); e.y=o.value("y").toInt(); e.button=o.value("btn").toInt(); e.pressed=o.value("down").toBool(); }
-                else if (type=="key") { e.type=Event::Key; e.keycode=o.value("code").toInt(); e.pressed=o.value("down").toBool(); }
-                out.push_back(e);
-            }
-        } else if (doc.isArray()) {
-            for (auto v : doc.array()) {
-                auto o = v.toObject(); Event e{}; e.ms_since_start = (std::int64_t)o.value("t").toDouble(); auto type = o.value("type").toString();
-                if (type=="mm") { e.type=Event::MouseMove; e.x=o.value("x").toInt(); e.y=o.value("y").toInt(); }
-                else if (type=="mb") { e.type=Event::MouseButton; e.x=o.value("x").toInt(); e.y=o.value("y").toInt(); e.button=o.value("btn").toInt(); e.pressed=o.value("down").toBool(); }
-                else if (type=="key") { e.type=Event::Key; e.keycode=o.value("code").toInt(); e.pressed=o.value("down").toBool(); }
-                out.push_back(e);
-            }
+    // JSON: one document, the probe's log under "echo"; CSV: one file per log (*-echo.csv).
+    static bool exportTiming(QString path, const LatenessLog *schedule, const LatenessLog *echo) {
+        auto writeFile = [](const QString &p, const QByteArray &data) {
+            QFile f(p); if (!f.open(QIODevice::WriteOnly)) return false;
+            bool ok = f.write(data) == data.size(); f.close(); return ok;
+        };
+        if (path.endsWith(".csv", Qt::CaseInsensitive)) {
+            bool ok = true;
+            if (schedule) ok = writeFile(path, schedule->toCsv());
+            if (echo) ok = writeFile(schedule ? path.left(path.size() - 4) + "-echo.csv" : path, echo->toCsv()) && ok;
+            return ok;
         }
+        if (!path.endsWith(".json", Qt::CaseInsensitive)) path += ".json";
+        QJsonObject root = schedule ? schedule->toJson() : QJsonObject();
+        root["format"] = "recq-timing-v1";
+        if (echo) root["echo"] = echo->toJson();
+        return writeFile(path, QJsonDocument(root).toJson(QJsonDocument::Compact));
+    }
+
+    static bool saveRecqV2(const QString &path, const Macro &macro) {
+        RecqV2Writer w; if (!w.open(path)) return false;
+        w.addMonitors(0, macro.monitors);
+        macro.forEachEvent([&](const Event &e) { w.append(e); });
+        return w.close();
+    }
+
+    // damaged, if given: set when a recq-v1 file turned out cut short or malformed part-way
+    static Macro loadRecq(const QString &path, bool *damaged = nullptr) {
+        if (damaged) *damaged = false;
+        Macro out; QFile f(path); if (!f.open(QIODevice::ReadOnly)) return out;
+        QByteArray head = f.peek(sizeof(kRecqStreamHeader));
+        if (isRecqV2(head)) { // played in place, see MappedRecq
+            f.close();
+            if ((out.mapped = MappedRecq::open(path))) out.monitors = out.mapped->monitors();
+            return out;
+        }
+        if (head.startsWith(kRecqStreamHeader)) { auto data = f.readAll(); f.close(); return loadRecqStream(data); }
+        bool ok = RecqV1Reader(f).read([&](const Event &e) { out.events.push_back(e); }, out.monitors);
+        if (damaged) *damaged = !ok;
         return out;
     }
 
@@ -867,11 +3030,49 @@ signals:
 }; // end MainWindow
 
 // ---------- main ----------
+// Headless playback with the end-to-end probe, for benchmarks (e.g. under Xvfb).
+static int runBenchmark(const QStringList &args) {
+    const char *usage = "usage: BiggerTask --bench macro.recq [--loops N] [--speed X] [--from S] [--to S] [--asap] [--out timing.json|timing.csv]\n";
+    if (args.isEmpty()) { fputs(usage, stderr); return 2; }
+    PlayerThread player;
+    player.measureEcho = true;
+    QString out;
+    for (int i = 1; i < args.size(); ++i) {
+        if (args.at(i) == "--asap") player.asap = true;
+        else if (args.at(i) == "--loops" && i + 1 < args.size()) player.loops = std::max(1, args.at(++i).toInt());
+        else if (args.at(i) == "--speed" && i + 1 < args.size()) player.speed = std::max(0.1, args.at(++i).toDouble());
+        else if (args.at(i) == "--from" && i + 1 < args.size()) player.startUs = std::llround(args.at(++i).toDouble() * 1e6);
+        else if (args.at(i) == "--to" && i + 1 < args.size()) player.endUs = std::llround(args.at(++i).toDouble() * 1e6);
+        else if (args.at(i) == "--out" && i + 1 < args.size()) out = args.at(++i);
+        else { fputs(usage, stderr); return 2; }
+    }
+    player.macro = std::make_shared<const Macro>(MainWindow::loadRecq(args.at(0)));
+    if (player.macro->empty()) { fprintf(stderr, "No events in %s\n", qPrintable(args.at(0))); return 1; }
+
+    bool finished = false;
+    QObject::connect(&player, &PlayerThread::status, [&](const QString &s) {
+        fprintf(stderr, "%s\n", qPrintable(s));
+        if (s.contains("finished")) finished = true;
+    });
+    QEventLoop loop;
+    QObject::connect(&player, &QThread::finished, &loop, &QEventLoop::quit);
+    player.start();
+    loop.exec();
+    player.wait();
+    if (!out.isEmpty() && !MainWindow::exportTiming(out, player.report.get(), player.echoReport.get())) {
+        fprintf(stderr, "Failed to write %s\n", qPrintable(out));
+        return 1;
+    }
+    return finished ? 0 : 1;
+}
+
 
 
 int main(int argc, char *argv[]) {
     qRegisterMetaType<std::vector<unsigned int>>("std::vector<unsigned int>");
     QApplication app(argc, argv);
+    int bench = app.arguments().indexOf("--bench");
+    if (bench >= 0) return runBenchmark(app.arguments().mid(bench + 1));
     app.setWindowIcon(QIcon(":/icons/BiggerTask.svg"));
     MainWindow w;
     w.setWindowTitle("BiggerTask");